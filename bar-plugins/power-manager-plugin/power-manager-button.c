@@ -36,6 +36,7 @@
 #include "common/blpm-common.h"
 #include "common/blpm-config.h"
 #include "common/blpm-icons.h"
+#include "common/blpm-icon-cache.h"
 #include "common/blpm-power-common.h"
 #include "common/blpm-brightness.h"
 
@@ -61,9 +62,19 @@ struct PowerManagerButtonPrivate
 
     /* A list of BatteryDevices  */
     GList           *devices;
-
-    /* The left-click popup menu, if one is being displayed */
+    /* Object path -> link in the devices list */
+    GHashTable      *device_table;
+    /* The battery or ups with the highest charge, used when upower
+     * has no display device */
+    gpointer         best_battery;
+
+    /* The left-click popup menu, built on first use and then kept
+     * up to date as devices come and go */
     GtkWidget       *menu;
+    /* Separator between the device items and the rest of the menu */
+    GtkWidget       *menu_separator;
+    /* Number of device items at the top of the menu */
+    gint             menu_n_devices;
 
     /* The actual bar icon image */
     GtkWidget       *bar_icon_image;
@@ -102,6 +113,8 @@ typedef struct
     gchar       *details;           /* Description of the device + state */
     gchar       *object_path;       /* UpDevice object path */
     UpDevice    *device;            /* Pointer to the UpDevice */
+    guint        kind;              /* Last seen device kind */
+    gdouble      percentage;        /* Last seen charge percentage */
     gulong       changed_signal_id; /* device changed callback id */
     gulong       expose_signal_id;  /* expose-event callback id */
     GtkWidget   *menu_item;         /* The device's item on the menu (if shown) */
@@ -128,61 +141,83 @@ static GList* find_device_in_list (PowerManagerButton *button, const gchar *obje
 static gboolean power_manager_button_device_icon_expose (GtkWidget *img, GdkEventExpose *event, gpointer userdata);
 static gboolean power_manager_button_set_icon (PowerManagerButton *button);
 static gboolean power_manager_button_press_event (GtkWidget *widget, GdkEventButton *event);
-static gboolean power_manager_button_menu_add_device (PowerManagerButton *button, BatteryDevice *battery_device, gboolean append);
+static gboolean power_manager_button_menu_add_device (PowerManagerButton *button, BatteryDevice *battery_device);
 static void increase_brightness (PowerManagerButton *button);
 static void decrease_brightness (PowerManagerButton *button);
 static void battery_device_remove_pix (BatteryDevice *battery_device);
 
 
-static BatteryDevice*
-get_display_device (PowerManagerButton *button)
+static gboolean
+battery_device_is_battery (BatteryDevice *battery_device)
+{
+    return battery_device->kind == UP_DEVICE_KIND_BATTERY ||
+           battery_device->kind == UP_DEVICE_KIND_UPS;
+}
+
+/* Only called when the current best battery went away or lost
+ * charge, every other change is handled in update_best_battery */
+static void
+find_best_battery (PowerManagerButton *button)
 {
     GList *item = NULL;
     gdouble highest_percentage = 0;
-    BatteryDevice *display_device = NULL;
+    BatteryDevice *best = NULL;
 
-    TRACE("entering");
+    for (item = g_list_first (button->priv->devices); item != NULL; item = g_list_next (item))
+    {
+        BatteryDevice *battery_device = item->data;
 
-    g_return_val_if_fail ( POWER_MANAGER_IS_BUTTON(button), NULL );
+        if ( !battery_device_is_battery (battery_device) )
+            continue;
 
-    if (button->priv->display_device)
-    {
-        item = find_device_in_list (button, up_device_get_object_path (button->priv->display_device));
-        if (item)
+        if ( highest_percentage < battery_device->percentage )
         {
-            return item->data;
+            best = battery_device;
+            highest_percentage = battery_device->percentage;
         }
     }
 
-    /* We want to find the battery or ups device with the highest percentage
-     * and use that to get our tooltip from */
-    for (item = g_list_first (button->priv->devices); item != NULL; item = g_list_next (item))
+    button->priv->best_battery = best;
+}
+
+static void
+update_best_battery (PowerManagerButton *button, BatteryDevice *battery_device)
+{
+    BatteryDevice *best = button->priv->best_battery;
+
+    if ( battery_device == best )
     {
-        BatteryDevice *battery_device = item->data;
-        guint type = 0;
-        gdouble percentage;
+        /* it can only have been overtaken if it lost charge or kind */
+        find_best_battery (button);
+    }
+    else if ( battery_device_is_battery (battery_device) &&
+              (best == NULL || best->percentage < battery_device->percentage) )
+    {
+        button->priv->best_battery = battery_device;
+    }
+}
 
-        if (!battery_device->device || !UP_IS_DEVICE(battery_device->device))
-        {
-            continue;
-        }
+static BatteryDevice*
+get_display_device (PowerManagerButton *button)
+{
+    GList *item = NULL;
 
-        g_object_get (battery_device->device,
-                      "kind", &type,
-                      "percentage", &percentage,
-                      NULL);
+    TRACE("entering");
 
-        if ( type == UP_DEVICE_KIND_BATTERY || type == UP_DEVICE_KIND_UPS)
+    g_return_val_if_fail ( POWER_MANAGER_IS_BUTTON(button), NULL );
+
+    if (button->priv->display_device)
+    {
+        item = find_device_in_list (button, up_device_get_object_path (button->priv->display_device));
+        if (item)
         {
-            if ( highest_percentage < percentage )
-            {
-                display_device = battery_device;
-                highest_percentage = percentage;
-            }
+            return item->data;
         }
     }
 
-    return display_device;
+    /* We want the battery or ups device with the highest percentage
+     * to get our tooltip from */
+    return button->priv->best_battery;
 }
 
 static void
@@ -227,77 +262,74 @@ power_manager_button_set_tooltip (PowerManagerButton *button)
 static GList*
 find_device_in_list (PowerManagerButton *button, const gchar *object_path)
 {
-    GList *item = NULL;
-
     TRACE("entering");
 
     g_return_val_if_fail ( POWER_MANAGER_IS_BUTTON(button), NULL );
 
-    for (item = g_list_first (button->priv->devices); item != NULL; item = g_list_next (item))
-    {
-        BatteryDevice *battery_device = item->data;
-        if (battery_device == NULL)
-        {
-            DBG("!battery_device");
-            continue;
-        }
+    if ( object_path == NULL )
+        return NULL;
 
-        if (g_strcmp0 (battery_device->object_path, object_path) == 0)
-            return item;
-    }
-
-    return NULL;
+    return g_hash_table_lookup (button->priv->device_table, object_path);
 }
 
-static gboolean
-power_manager_button_device_icon_expose (GtkWidget *img, GdkEventExpose *event, gpointer userdata)
-{
-    cairo_t *cr;
-    UpDevice *device = NULL;
-    guint type = 0, state = 0;
-    gdouble percentage;
-    gint height, width;
-    gdouble min_height = 2;
-    PangoLayout *layout = NULL;
-    PangoRectangle ink_extent, log_extent;
+/* Overlays drawn on top of the menu device icons, keyed on what they
+ * look like, so an expose only has to paint a ready made surface */
+static GHashTable           *device_overlays = NULL;
+static PangoFontDescription *device_overlay_font = NULL;
+/* buttons sharing the cache, the last one frees it */
+static guint                 device_overlay_users = 0;
 
-    TRACE("entering");
+/* the overlays draw a little past the right edge of the image */
+#define DEVICE_OVERLAY_MARGIN (4)
 
-    /* sanity checks */
-    if (!img || !GTK_IS_WIDGET (img))
-        return FALSE;
+/* a handful of sizes times 101 percentages, flushed past that */
+#define DEVICE_OVERLAY_MAX (256)
 
-    if (UP_IS_DEVICE (userdata))
-    {
-        device = UP_DEVICE(userdata);
+static void
+power_manager_button_device_overlays_ref (void)
+{
+    device_overlay_users++;
+}
 
-        g_object_get (device,
-                      "kind", &type,
-                      "state", &state,
-                      "percentage", &percentage,
-                      NULL);
+static void
+power_manager_button_device_overlays_unref (void)
+{
+    if (--device_overlay_users > 0)
+        return;
 
-        /* Don't draw the progressbar for Battery and UPS */
-        if (type == UP_DEVICE_KIND_BATTERY || type == UP_DEVICE_KIND_UPS)
-            return FALSE;
+    if (device_overlays != NULL)
+    {
+        g_hash_table_destroy (device_overlays);
+        device_overlays = NULL;
     }
-    else
+
+    if (device_overlay_font != NULL)
     {
-        /* If the UpDevice hasn't fully updated yet it then we'll want
-         * a question mark for sure. */
-        state = UP_DEVICE_STATE_UNKNOWN;
+        pango_font_description_free (device_overlay_font);
+        device_overlay_font = NULL;
     }
+}
 
-    cr = gdk_cairo_create (img->window);
-    width = img->allocation.width;
-    height = img->allocation.height;
+static cairo_surface_t *
+power_manager_button_render_device_overlay (GtkWidget *img, gboolean unknown, gint percent,
+                                            gint width, gint height)
+{
+    cairo_surface_t *surface;
+    cairo_t *cr;
+    gdouble min_height = 2;
+    PangoLayout *layout;
+    PangoRectangle ink_extent, log_extent;
+
+    surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                          width + DEVICE_OVERLAY_MARGIN, height);
+    cr = cairo_create (surface);
 
-    if (state != UP_DEVICE_STATE_UNKNOWN)
+    if (!unknown)
     {
         /* Draw the trough of the progressbar */
         cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
         cairo_set_line_width (cr, 1.0);
-        cairo_rectangle (cr, width - 3.5, img->allocation.y + 1.5, 5, height - 2);
+        cairo_rectangle (cr, width - 3.5, 1.5, 5, height - 2);
         cairo_set_source_rgb (cr, 0.87, 0.87, 0.87);
         cairo_fill_preserve (cr);
         cairo_set_source_rgb (cr, 0.53, 0.54, 0.52);
@@ -307,21 +339,21 @@ power_manager_button_device_icon_expose (GtkWidget *img, GdkEventExpose *event,
            Use yellow for 20% and below, green for 100%, red for 5% and below and blue for the rest */
         cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
 
-        if ((height * (percentage / 100)) > min_height)
-           min_height = (height - 3) * (percentage / 100);
+        if ((height * (percent / 100.0)) > min_height)
+           min_height = (height - 3) * (percent / 100.0);
 
-        cairo_rectangle (cr, width - 3, img->allocation.y + height - min_height - 1, 4, min_height);
-        if (percentage > 5 && percentage < 20)
+        cairo_rectangle (cr, width - 3, height - min_height - 1, 4, min_height);
+        if (percent > 5 && percent < 20)
             cairo_set_source_rgb (cr, 0.93, 0.83, 0.0);
-        else if (percentage > 20 && percentage < 100)
+        else if (percent > 20 && percent < 100)
             cairo_set_source_rgb (cr, 0.2, 0.4, 0.64);
-        else if (percentage == 100)
+        else if (percent == 100)
             cairo_set_source_rgb (cr, 0.45, 0.82, 0.08);
         else
             cairo_set_source_rgb (cr, 0.94, 0.16, 0.16);
         cairo_fill (cr);
 
-        cairo_rectangle (cr, width - 2.5, img->allocation.y + 2.5, 3, height - 4);
+        cairo_rectangle (cr, width - 2.5, 2.5, 3, height - 4);
         cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 0.75);
         cairo_stroke (cr);
     }
@@ -330,23 +362,111 @@ power_manager_button_device_icon_expose (GtkWidget *img, GdkEventExpose *event,
         /* Draw a bubble with a question mark for devices with unknown state */
         cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
         cairo_set_line_width (cr, 1.0);
-        cairo_arc(cr, width - 4.5, img->allocation.y + 6.5, 6, 0, 2*3.14159);
+        cairo_arc(cr, width - 4.5, 6.5, 6, 0, 2*3.14159);
         cairo_set_source_rgb (cr, 0.2, 0.54, 0.9);
         cairo_fill_preserve (cr);
         cairo_set_source_rgb (cr, 0.1, 0.37, 0.6);
         cairo_stroke (cr);
 
-        layout = gtk_widget_create_pango_layout (GTK_WIDGET (img), "?");
-        pango_layout_set_font_description (layout, pango_font_description_from_string ("Sans Bold 9"));
+        if (device_overlay_font == NULL)
+            device_overlay_font = pango_font_description_from_string ("Sans Bold 9");
+
+        /* the widget's context, so font options and DPI match the screen */
+        layout = gtk_widget_create_pango_layout (img, "?");
+        pango_layout_set_font_description (layout, device_overlay_font);
+
         pango_layout_get_pixel_extents (layout, &ink_extent, &log_extent);
-        cairo_move_to (cr, (width - 5.5) - (log_extent.width / 2), (img->allocation.y + 5.5) - (log_extent.height / 2));
+        cairo_move_to (cr, (width - 5.5) - (log_extent.width / 2), 5.5 - (log_extent.height / 2));
         cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
         pango_cairo_show_layout (cr, layout);
+        g_object_unref (layout);
     }
 
     cairo_destroy (cr);
-    if (layout)
-        g_object_unref (layout);
+
+    return surface;
+}
+
+static cairo_surface_t *
+power_manager_button_get_device_overlay (GtkWidget *img, gboolean unknown, gdouble percentage,
+                                         gint width, gint height)
+{
+    cairo_surface_t *surface;
+    gint percent;
+    gchar *key;
+
+    if (device_overlays == NULL)
+        device_overlays = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                 (GDestroyNotify) cairo_surface_destroy);
+
+    /* one bucket per percent is finer than the bar can show */
+    percent = unknown ? 0 : CLAMP ((gint) (percentage + 0.5), 0, 100);
+
+    key = g_strdup_printf ("%d:%d:%dx%d", unknown, percent, width, height);
+
+    surface = g_hash_table_lookup (device_overlays, key);
+    if (surface == NULL)
+    {
+        if (g_hash_table_size (device_overlays) >= DEVICE_OVERLAY_MAX)
+            g_hash_table_remove_all (device_overlays);
+
+        surface = power_manager_button_render_device_overlay (img, unknown, percent, width, height);
+        g_hash_table_insert (device_overlays, key, surface);
+    }
+    else
+    {
+        g_free (key);
+    }
+
+    return surface;
+}
+
+static gboolean
+power_manager_button_device_icon_expose (GtkWidget *img, GdkEventExpose *event, gpointer userdata)
+{
+    cairo_t *cr;
+    UpDevice *device = NULL;
+    guint type = 0, state = 0;
+    gdouble percentage = 0;
+    cairo_surface_t *overlay;
+
+    TRACE("entering");
+
+    /* sanity checks */
+    if (!img || !GTK_IS_WIDGET (img))
+        return FALSE;
+
+    if (UP_IS_DEVICE (userdata))
+    {
+        device = UP_DEVICE(userdata);
+
+        g_object_get (device,
+                      "kind", &type,
+                      "state", &state,
+                      "percentage", &percentage,
+                      NULL);
+
+        /* Don't draw the progressbar for Battery and UPS */
+        if (type == UP_DEVICE_KIND_BATTERY || type == UP_DEVICE_KIND_UPS)
+            return FALSE;
+    }
+    else
+    {
+        /* If the UpDevice hasn't fully updated yet it then we'll want
+         * a question mark for sure. */
+        state = UP_DEVICE_STATE_UNKNOWN;
+    }
+
+    overlay = power_manager_button_get_device_overlay (img, state == UP_DEVICE_STATE_UNKNOWN,
+                                                       percentage,
+                                                       img->allocation.width,
+                                                       img->allocation.height);
+
+    cr = gdk_cairo_create (img->window);
+    cairo_set_source_surface (cr, overlay, 0, img->allocation.y);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+
     return FALSE;
 }
 
@@ -376,16 +496,19 @@ power_manager_button_update_device_icon_and_details (PowerManagerButton *button,
     /* hack, this depends on XFPM_DEVICE_TYPE_* being in sync with UP_DEVICE_KIND_* */
     g_object_get (device,
 		  "kind", &type,
+		  "percentage", &battery_device->percentage,
 		   NULL);
+    battery_device->kind = type;
+
+    update_best_battery (button, battery_device);
 
     icon_name = get_device_icon_name (button->priv->upower, device);
     details = get_device_description(button->priv->upower, device);
 
-    pix = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
-				    icon_name,
-				    32,
-				    GTK_ICON_LOOKUP_USE_BUILTIN,
-				    NULL);
+    pix = blpm_icon_cache_load (icon_name,
+				32,
+				GTK_ICON_LOOKUP_USE_BUILTIN,
+				NULL);
 
     if (battery_device->details)
 	g_free(battery_device->details);
@@ -409,7 +532,7 @@ power_manager_button_update_device_icon_and_details (PowerManagerButton *button,
 	power_manager_button_set_tooltip (button);
     }
 
-    /* If the menu is being displayed, update it */
+    /* If the device is on the menu, update its item */
     if (button->priv->menu && battery_device->menu_item)
     {
         gtk_menu_item_set_label (GTK_MENU_ITEM (battery_device->menu_item), details);
@@ -473,14 +596,17 @@ power_manager_button_add_device (UpDevice *device, PowerManagerButton *button)
 
     /* add it to the list */
     button->priv->devices = g_list_append (button->priv->devices, battery_device);
+    g_hash_table_insert (button->priv->device_table,
+                         battery_device->object_path,
+                         g_list_last (button->priv->devices));
 
     /* Add the icon and description for the device */
     power_manager_button_update_device_icon_and_details (button, device);
 
-    /* If the menu is being shown, add this new device to it */
+    /* If the menu has been built, add this new device to it */
     if (button->priv->menu)
     {
-	power_manager_button_menu_add_device (button, battery_device, FALSE);
+	power_manager_button_menu_add_device (button, battery_device);
     }
 }
 
@@ -552,11 +678,19 @@ power_manager_button_remove_device (PowerManagerButton *button, const gchar *obj
 
     battery_device = item->data;
 
+    /* the table is keyed on the battery device's own path string */
+    g_hash_table_remove (button->priv->device_table, object_path);
+
     /* Remove its resources */
     remove_battery_device (button, battery_device);
 
     /* remove it item and free the battery device */
     button->priv->devices = g_list_delete_link (button->priv->devices, item);
+
+    if ( button->priv->best_battery == battery_device )
+        find_best_battery (button);
+
+    g_free (battery_device);
 }
 
 static void
@@ -628,7 +762,13 @@ power_manager_button_remove_all_devices (PowerManagerButton *button)
 
         /* Remove its resources */
         remove_battery_device (button, battery_device);
+        g_free (battery_device);
     }
+
+    g_hash_table_remove_all (button->priv->device_table);
+    g_list_free (button->priv->devices);
+    button->priv->devices = NULL;
+    button->priv->best_battery = NULL;
 }
 
 static void
@@ -821,6 +961,8 @@ power_manager_button_init (PowerManagerButton *button)
     button->priv->set_level_timeout = 0;
 
     button->priv->upower  = up_client_new ();
+    button->priv->device_table = g_hash_table_new (g_str_hash, g_str_equal);
+    power_manager_button_device_overlays_ref ();
     if ( !blconf_init (&error) )
     {
         g_critical ("blconf_init failed: %s\n", error->message);
@@ -859,6 +1001,16 @@ power_manager_button_finalize (GObject *object)
     g_signal_handlers_disconnect_by_data (button->priv->upower, button);
 
     power_manager_button_remove_all_devices (button);
+    g_hash_table_destroy (button->priv->device_table);
+
+    if (button->priv->menu)
+    {
+        g_signal_handlers_disconnect_by_data (button->priv->menu, button);
+        gtk_widget_destroy (button->priv->menu);
+        button->priv->menu = NULL;
+    }
+
+    power_manager_button_device_overlays_unref ();
 
 #ifdef XFCE_PLUGIN
     g_object_unref (button->priv->plugin);
@@ -899,11 +1051,10 @@ power_manager_button_set_icon (PowerManagerButton *button)
 
     DBG("icon_width %d", button->priv->bar_icon_width);
 
-    pixbuf = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
-                                       button->priv->bar_icon_name,
-                                       button->priv->bar_icon_width,
-                                       GTK_ICON_LOOKUP_GENERIC_FALLBACK,
-                                       NULL);
+    pixbuf = blpm_icon_cache_load (button->priv->bar_icon_name,
+                                   button->priv->bar_icon_width,
+                                   GTK_ICON_LOOKUP_GENERIC_FALLBACK,
+                                   NULL);
 
     if ( pixbuf )
     {
@@ -1037,19 +1188,26 @@ power_manager_button_show (PowerManagerButton *button)
 }
 
 static void
-menu_destroyed_cb(GtkMenuShell *menu, gpointer user_data)
+menu_deactivate_cb(GtkMenuShell *menu, gpointer user_data)
 {
     PowerManagerButton *button = POWER_MANAGER_BUTTON (user_data);
 
     TRACE("entering");
 
-    /* menu destroyed, range slider is gone */
-    button->priv->range = NULL;
-
-    /* untoggle bar icon */
+    /* untoggle bar icon, the menu itself is kept for the next click */
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(button), FALSE);
+}
+
+static void
+power_manager_button_menu_update_separator (PowerManagerButton *button)
+{
+    if (button->priv->menu_separator == NULL)
+        return;
 
-    button->priv->menu = NULL;
+    if (button->priv->menu_n_devices > 0)
+        gtk_widget_show (button->priv->menu_separator);
+    else
+        gtk_widget_hide (button->priv->menu_separator);
 }
 
 static void
@@ -1065,6 +1223,8 @@ menu_item_destroyed_cb(GtkWidget *object, gpointer user_data)
         if (battery_device->menu_item == object)
         {
             battery_device->menu_item = NULL;
+            button->priv->menu_n_devices--;
+            power_manager_button_menu_update_separator (button);
             return;
         }
     }
@@ -1090,28 +1250,20 @@ menu_item_activate_cb(GtkWidget *object, gpointer user_data)
 }
 
 static gboolean
-power_manager_button_menu_add_device (PowerManagerButton *button, BatteryDevice *battery_device, gboolean append)
+power_manager_button_menu_add_device (PowerManagerButton *button, BatteryDevice *battery_device)
 {
     GtkWidget *mi, *label;
-    guint type = 0;
 
     g_return_val_if_fail (POWER_MANAGER_IS_BUTTON (button), FALSE);
 
     /* We need a menu to attach it to */
     g_return_val_if_fail (button->priv->menu, FALSE);
 
-    if (UP_IS_DEVICE(battery_device->device))
+    /* Don't add the display device or line power to the menu */
+    if (battery_device->kind == UP_DEVICE_KIND_LINE_POWER || battery_device->device == button->priv->display_device)
     {
-        g_object_get (battery_device->device,
-                      "kind", &type,
-                      NULL);
-
-        /* Don't add the display device or line power to the menu */
-        if (type == UP_DEVICE_KIND_LINE_POWER || battery_device->device == button->priv->display_device)
-        {
-            DBG("filtering device from menu (display or line power device)");
-            return FALSE;
-        }
+        DBG("filtering device from menu (display or line power device)");
+        return FALSE;
     }
 
     mi = gtk_image_menu_item_new_with_label(battery_device->details);
@@ -1135,12 +1287,12 @@ power_manager_button_menu_add_device (PowerManagerButton *button, BatteryDevice
     /* Active calls blpm settings with the device's id to display details */
     g_signal_connect(G_OBJECT(mi), "activate", G_CALLBACK(menu_item_activate_cb), button);
 
-    /* Add it to the menu */
+    /* Add it to the end of the device items, above the separator */
     gtk_widget_show(mi);
-    if (append)
-	gtk_menu_shell_append(GTK_MENU_SHELL(button->priv->menu), mi);
-    else
-	gtk_menu_shell_prepend(GTK_MENU_SHELL(button->priv->menu), mi);
+    gtk_menu_shell_insert(GTK_MENU_SHELL(button->priv->menu), mi, button->priv->menu_n_devices);
+
+    button->priv->menu_n_devices++;
+    power_manager_button_menu_update_separator (button);
 
     return TRUE;
 }
@@ -1250,47 +1402,29 @@ range_show_cb (GtkWidget *widget, PowerManagerButton *button)
     gtk_grab_remove(widget);
 }
 
-void
-power_manager_button_show_menu (PowerManagerButton *button)
+static void
+power_manager_button_menu_build (PowerManagerButton *button)
 {
     GtkWidget *menu, *mi, *img = NULL;
-    GdkScreen *gscreen;
     GList *item;
-    gboolean show_separator_flag = FALSE;
-    gint32 max_level, current_level = 0;
+    gint32 max_level;
 
     TRACE("entering");
 
-    g_return_if_fail (POWER_MANAGER_IS_BUTTON (button));
-
-    if(gtk_widget_has_screen(GTK_WIDGET(button)))
-        gscreen = gtk_widget_get_screen(GTK_WIDGET(button));
-    else
-        gscreen = gdk_display_get_default_screen(gdk_display_get_default());
-
     menu = gtk_menu_new ();
-    gtk_menu_set_screen(GTK_MENU(menu), gscreen);
-    /* keep track of the menu while it's being displayed */
     button->priv->menu = menu;
-    g_signal_connect(GTK_MENU_SHELL(menu), "deactivate", G_CALLBACK(menu_destroyed_cb), button);
+    button->priv->menu_n_devices = 0;
+    g_signal_connect(GTK_MENU_SHELL(menu), "deactivate", G_CALLBACK(menu_deactivate_cb), button);
+
+    /* separator, only shown when there are device items above it */
+    button->priv->menu_separator = gtk_separator_menu_item_new();
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), button->priv->menu_separator);
 
     for (item = g_list_first (button->priv->devices); item != NULL; item = g_list_next (item))
     {
         BatteryDevice *battery_device = item->data;
 
-        if (power_manager_button_menu_add_device (button, battery_device, TRUE))
-        {
-            /* If we add an item to the menu, show the separator */
-            show_separator_flag = TRUE;
-        }
-    }
-
-    if (show_separator_flag)
-    {
-        /* separator */
-        mi = gtk_separator_menu_item_new();
-        gtk_widget_show(mi);
-        gtk_menu_shell_append(GTK_MENU_SHELL(menu), mi);
+        power_manager_button_menu_add_device (button, battery_device);
     }
 
     /* Display brightness slider - show if there's hardware support for it */
@@ -1303,11 +1437,10 @@ power_manager_button_show_menu (PowerManagerButton *button)
         mi = scale_menu_item_new_with_range (button->priv->brightness_min_level, max_level, 1);
 
         /* attempt to load and display the brightness icon */
-        pix = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
-                                       XFPM_DISPLAY_BRIGHTNESS_ICON,
-                                       32,
-                                       GTK_ICON_LOOKUP_GENERIC_FALLBACK,
-                                       NULL);
+        pix = blpm_icon_cache_load (XFPM_DISPLAY_BRIGHTNESS_ICON,
+                                    32,
+                                    GTK_ICON_LOOKUP_GENERIC_FALLBACK,
+                                    NULL);
         if (pix)
         {
             img = gtk_image_new_from_pixbuf (pix);
@@ -1319,10 +1452,6 @@ power_manager_button_show_menu (PowerManagerButton *button)
         /* range slider */
         button->priv->range = scale_menu_item_get_scale (SCALE_MENU_ITEM (mi));
 
-        /* update the slider to the current brightness level */
-        blpm_brightness_get_level (button->priv->brightness, &current_level);
-        gtk_range_set_value (GTK_RANGE(button->priv->range), current_level);
-
         g_signal_connect_swapped (mi, "value-changed", G_CALLBACK (range_value_changed_cb), button);
         g_signal_connect (mi, "scroll-event", G_CALLBACK (range_scroll_cb), button);
         g_signal_connect (menu, "show", G_CALLBACK (range_show_cb), button);
@@ -1345,6 +1474,40 @@ power_manager_button_show_menu (PowerManagerButton *button)
     gtk_widget_show(mi);
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), mi);
     g_signal_connect(G_OBJECT(mi), "activate", G_CALLBACK(blpm_preferences), NULL);
+}
+
+void
+power_manager_button_show_menu (PowerManagerButton *button)
+{
+    GtkWidget *menu;
+    GdkScreen *gscreen;
+    gint32 current_level = 0;
+
+    TRACE("entering");
+
+    g_return_if_fail (POWER_MANAGER_IS_BUTTON (button));
+
+    if (button->priv->menu == NULL)
+        power_manager_button_menu_build (button);
+
+    menu = button->priv->menu;
+
+    if(gtk_widget_has_screen(GTK_WIDGET(button)))
+        gscreen = gtk_widget_get_screen(GTK_WIDGET(button));
+    else
+        gscreen = gdk_display_get_default_screen(gdk_display_get_default());
+
+    gtk_menu_set_screen(GTK_MENU(menu), gscreen);
+
+    /* the brightness may have been changed behind our back, e.g. by the keys */
+    if (button->priv->range)
+    {
+        blpm_brightness_get_level (button->priv->brightness, &current_level);
+        /* only the slider follows, nothing has to be written back */
+        g_signal_handlers_block_by_func (button->priv->range, range_value_changed_cb, button);
+        gtk_range_set_value (GTK_RANGE(button->priv->range), current_level);
+        g_signal_handlers_unblock_by_func (button->priv->range, range_value_changed_cb, button);
+    }
 
     gtk_menu_popup (GTK_MENU (menu),
                     NULL,
@@ -321,6 +321,7 @@ blpm_brightness_helper_get_value (const gchar *argument)
     gchar *command = NULL;
 
     command = g_strdup_printf (SBINDIR "/blpm-power-backlight-helper --%s", argument);
+    blpm_startup_count_spawn ();
     ret = g_spawn_command_line_sync (command,
 	    &stdout_data, NULL, &exit_status, &error);
     if ( !ret )
@@ -399,6 +400,7 @@ blpm_brightness_helper_set_level (XfpmBrightness *brg, gint32 level)
     gchar *command = NULL;
 
     command = g_strdup_printf ("pkexec " SBINDIR "/blpm-power-backlight-helper --set-brightness %i", level);
+    blpm_startup_count_spawn ();
     ret = g_spawn_command_line_sync (command, NULL, NULL, &exit_status, &error);
     if ( !ret )
     {
@@ -439,6 +441,7 @@ blpm_brightness_helper_set_switch (XfpmBrightness *brg, gint brightness_switch)
     gchar *command = NULL;
 
     command = g_strdup_printf ("pkexec " SBINDIR "/blpm-power-backlight-helper --set-brightness-switch %i", brightness_switch);
+    blpm_startup_count_spawn ();
     ret = g_spawn_command_line_sync (command, NULL, NULL, &exit_status, &error);
     if ( !ret )
     {
@@ -661,6 +664,27 @@ gboolean blpm_brightness_down (XfpmBrightness *brightness, gint32 *new_level)
     return ret;
 }
 
+/*
+ * Moves by several steps at once, negative steps go down. Used for
+ * held keys so the hardware is written once per batch.
+ */
+gboolean blpm_brightness_step (XfpmBrightness *brightness, gint steps, gint32 *new_level)
+{
+    gint32 hw_level;
+    gint32 set_level;
+    
+    if ( !blpm_brightness_get_level (brightness, &hw_level) )
+	return FALSE;
+	
+    set_level = CLAMP (hw_level + steps * brightness->priv->step,
+		       brightness->priv->min_level, brightness->priv->max_level);
+		       
+    if ( set_level != hw_level )
+	g_warn_if_fail (blpm_brightness_set_level (brightness, set_level));
+	
+    return blpm_brightness_get_level (brightness, new_level);
+}
+
 gboolean blpm_brightness_has_hw (XfpmBrightness *brightness)
 {
     return brightness->priv->xrandr_has_hw || brightness->priv->helper_has_hw;
@@ -56,6 +56,10 @@ gboolean			blpm_brightness_up		(XfpmBrightness *brightness,
 gboolean			blpm_brightness_down		(XfpmBrightness *brightness,
 								 gint32 *new_level);
 
+gboolean			blpm_brightness_step		(XfpmBrightness *brightness,
+								 gint steps,
+								 gint32 *new_level);
+
 gboolean			blpm_brightness_has_hw 		(XfpmBrightness *brightness);
 
 gint32 			blpm_brightness_get_max_level   (XfpmBrightness *brightness);
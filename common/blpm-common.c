@@ -23,6 +23,7 @@
 #include <libbladeutil/libbladeutil.h>
 
 #include "blpm-common.h"
+#include "blpm-icon-cache.h"
 
 const gchar *blpm_bool_to_string (gboolean value)
 {
@@ -52,35 +53,6 @@ GtkBuilder *blpm_builder_new_from_string (const gchar *ui, GError **error)
     return builder;
 }
 
-gboolean
-blpm_lock_screen (void)
-{
-    gboolean ret = g_spawn_command_line_async ("xflock4", NULL);
-    
-    if ( !ret )
-    {
-        ret = g_spawn_command_line_async ("gnome-screensaver-command -l", NULL);
-    }
-    
-    if ( !ret )
-    {
-        /* this should be the default*/
-        ret = g_spawn_command_line_async ("xdg-screensaver lock", NULL);
-    }
-    
-    if ( !ret )
-    {
-        ret = g_spawn_command_line_async ("xscreensaver-command -lock", NULL);
-    }
-    
-    if ( !ret )
-    {
-        g_critical ("Connot lock screen\n");
-    }
-
-    return ret;
-}
-
 void       
 blpm_preferences (void) 
 {
@@ -175,11 +147,10 @@ GdkPixbuf *blpm_icon_load (const gchar *icon_name, gint size)
     GdkPixbuf *pix = NULL;
     GError *error = NULL;
     
-    pix = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (), 
-				    icon_name, 
-				    size,
-				    GTK_ICON_LOOKUP_USE_BUILTIN,
-				    &error);
+    pix = blpm_icon_cache_load (icon_name,
+				size,
+				GTK_ICON_LOOKUP_USE_BUILTIN,
+				&error);
 				    
     if ( error )
     {
@@ -40,8 +40,6 @@ gboolean        blpm_string_to_bool     	(const gchar *string) G_GNUC_PURE;
 GtkBuilder     *blpm_builder_new_from_string   	(const gchar *file,
 						 GError **error);
 
-gboolean   	blpm_lock_screen  		(void);
-
 void       	blpm_preferences		(void);
 
 void        blpm_preferences_device_id (const gchar* object_path);
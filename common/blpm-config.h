@@ -76,6 +76,15 @@ G_BEGIN_DECLS
 #define BRIGHTNESS_SWITCH_SAVE               "brightness-switch-restore-on-exit"
 #define HANDLE_BRIGHTNESS_KEYS               "handle-brightness-keys"
 #define SHOW_BRIGHTNESS_POPUP                "show-brightness-popup"
+#define ADAPTIVE_DIM                         "adaptive-dim"
+#define ADAPTIVE_DIM_MAX_TIMEOUT             "adaptive-dim-max-timeout"
+#define ADAPTIVE_DIM_STATE_ON_AC             "adaptive-dim-state-on-ac"
+#define ADAPTIVE_DIM_STATE_ON_BATTERY        "adaptive-dim-state-on-battery"
+
+/* Written by the settings dialog ahead of a group of changes and reset
+ * after it, holds the ';' separated keys that follow so the daemon can
+ * apply them together */
+#define SETTINGS_BATCH                       "settings-batch"
 
 G_END_DECLS
 
@@ -32,7 +32,121 @@
 
 #include "blpm-debug.h"
 
+typedef struct
+{
+    const gchar *name;
+    guint        depth;
+    gint64       begin;
+    gint64       end;
+    guint        dbus_calls;
+    guint        spawns;
+
+} XfpmStartupPhase;
+
+/* Number of events kept, the oldest ones are overwritten */
+#define XFPM_TRACE_RING_SIZE	512
+/* Longer messages are truncated */
+#define XFPM_TRACE_MESSAGE_LEN	96
+
+typedef enum
+{
+    XFPM_TRACE_DEBUG,
+    XFPM_TRACE_WARNING,
+    XFPM_TRACE_ENUM
+
+} XfpmTraceKind;
+
+/*
+ * One recorded trace. The strings coming from the macros are static
+ * and only referenced, enums are kept raw and named when dumped.
+ */
+typedef struct
+{
+    gint64       time;		/* monotonic, in us */
+    const gchar *func;
+    const gchar *file;
+    gint         line;
+    gint         v_enum;
+    GType        type;
+    guint8       kind;
+    gchar        message [XFPM_TRACE_MESSAGE_LEN];
+
+} XfpmTraceEvent;
+
+gboolean blpm_debug_enabled = FALSE;
+
 static gboolean enable_debug = FALSE;
+static gboolean enable_trace = FALSE;
+
+static XfpmTraceEvent trace_ring [XFPM_TRACE_RING_SIZE];
+static guint          trace_next  = 0;
+static guint          trace_len   = 0;
+static guint64        trace_total = 0;
+
+static GArray  *startup_phases = NULL;	/* XfpmStartupPhase, in begin order */
+static GArray  *startup_stack  = NULL;	/* indexes of the open phases */
+static gint64   startup_origin = 0;
+static gboolean startup_done   = FALSE;
+
+static const gchar *
+blpm_trace_enum_name (GType type, gint v_enum)
+{
+    GEnumClass *klass;
+    GEnumValue *value;
+
+    /* the type is registered by whoever traced it, its class may not be */
+    klass = g_type_class_peek (type);
+    if ( klass == NULL )
+	klass = g_type_class_ref (type);
+
+    value = g_enum_get_value (klass, v_enum);
+
+    return value != NULL ? value->value_name : "?";
+}
+
+static void
+blpm_trace_print (FILE *out, const XfpmTraceEvent *event)
+{
+    fprintf (out, "TRACE[%s:%d] %s(): %s%s%s%s\n",
+	     event->file, event->line, event->func,
+	     event->kind == XFPM_TRACE_WARNING ? "***WARNING***: " : "",
+	     event->message,
+	     event->kind == XFPM_TRACE_ENUM ? ": " : "",
+	     event->kind == XFPM_TRACE_ENUM ? blpm_trace_enum_name (event->type, event->v_enum) : "");
+}
+
+static void
+blpm_trace_record (XfpmTraceKind kind, const gchar *func, const gchar *file, gint line,
+		   gint v_enum, GType type, const gchar *format, va_list args)
+{
+    XfpmTraceEvent *event;
+    XfpmTraceEvent  printed;
+
+    /* without the ring the event only lives long enough to be printed */
+    if ( enable_trace )
+    {
+	event = &trace_ring [trace_next];
+	trace_next = (trace_next + 1) % XFPM_TRACE_RING_SIZE;
+	trace_len = MIN (trace_len + 1, XFPM_TRACE_RING_SIZE);
+	trace_total++;
+    }
+    else
+    {
+	event = &printed;
+    }
+
+    event->time   = g_get_monotonic_time ();
+    event->func   = func;
+    event->file   = file;
+    event->line   = line;
+    event->kind   = kind;
+    event->v_enum = v_enum;
+    event->type   = type;
+    g_vsnprintf (event->message, sizeof (event->message), format, args);
+
+    if ( enable_debug )
+	blpm_trace_print (stdout, event);
+}
 
 #if defined(G_HAVE_ISO_VARARGS)
 
@@ -40,18 +154,10 @@ void
 blpm_debug (const char *func, const char *file, int line, const char *format, ...)
 {
     va_list args;
-    
-    if ( !enable_debug )
-	return;
 
     va_start (args, format);
-
-    fprintf (stdout, "TRACE[%s:%d] %s(): ", file, line, func);
-    vfprintf (stdout, format, args);
-    fprintf (stdout, "\n");
-    
+    blpm_trace_record (XFPM_TRACE_DEBUG, func, file, line, 0, G_TYPE_INVALID, format, args);
     va_end (args);
-
 }
 
 void
@@ -59,15 +165,8 @@ blpm_warn (const char *func, const char *file, int line, const char *format, ...
 {
     va_list args;
 
-    if ( !enable_debug )
-	return;
-
     va_start (args, format);
-    
-    fprintf(stdout, "TRACE[%s:%d] %s(): ", file, line, func);
-    fprintf (stdout, "***WARNING***: ");
-    vfprintf (stdout, format, args);
-    fprintf (stdout, "\n");
+    blpm_trace_record (XFPM_TRACE_WARNING, func, file, line, 0, G_TYPE_INVALID, format, args);
     va_end (args);
 }
 
@@ -75,35 +174,177 @@ void blpm_debug_enum (const gchar *func, const gchar *file, gint line,
 		      gint v_enum, GType type, const gchar *format, ...)
 {
     va_list args;
-    gchar *buffer;
-    
-    gchar *content = NULL;
-    GValue __value__ = { 0, };
-    
-    if ( !enable_debug )
-	return;
-    
-    g_value_init (&__value__, type);
-    g_value_set_enum (&__value__, v_enum);
-    
-    content = g_strdup_value_contents (&__value__);
-    
+
     va_start (args, format);
-    g_vasprintf (&buffer, format, args);
+    blpm_trace_record (XFPM_TRACE_ENUM, func, file, line, v_enum, type, format, args);
     va_end (args);
-	
-    fprintf(stdout, "TRACE[%s:%d] %s(): ", file, line, func);
-    fprintf(stdout, "%s: %s", buffer, content);
-    fprintf(stdout, "\n");
-    
-    g_value_unset (&__value__);	
-    g_free (content);
-    g_free (buffer);
 }
 
 #endif /*defined(G_HAVE_ISO_VARARGS)*/
 
-void blpm_debug_init (gboolean debug)
+void blpm_debug_init (gboolean debug, gboolean trace)
 {
     enable_debug = debug;
+    enable_trace = trace;
+    blpm_debug_enabled = debug || trace;
+}
+
+/*
+ * The ring, oldest event first, one tab separated line per event with
+ * times in milliseconds before the dump.
+ */
+gchar *blpm_trace_to_string (void)
+{
+    const XfpmTraceEvent *event;
+    GString *str;
+    gint64 now;
+    guint i;
+
+    now = g_get_monotonic_time ();
+
+    str = g_string_new (NULL);
+
+    if ( !enable_trace )
+    {
+	g_string_append (str, "# tracing is off, run with --trace to record events\n");
+	return g_string_free (str, FALSE);
+    }
+
+    g_string_append_printf (str, "# %u of %" G_GUINT64_FORMAT " events kept\n",
+			    trace_len, trace_total);
+    g_string_append (str, "# age-ms\tkind\tlocation\tfunction\tmessage\n");
+
+    for ( i = 0; i < trace_len; i++ )
+    {
+	event = &trace_ring [(trace_next + XFPM_TRACE_RING_SIZE - trace_len + i) % XFPM_TRACE_RING_SIZE];
+
+	g_string_append_printf (str, "%.3f\t%c\t%s:%d\t%s\t%s",
+				(now - event->time) / 1000.0,
+				event->kind == XFPM_TRACE_WARNING ? 'W' : 'D',
+				event->file, event->line, event->func,
+				event->message);
+
+	if ( event->kind == XFPM_TRACE_ENUM )
+	    g_string_append_printf (str, ": %s", blpm_trace_enum_name (event->type, event->v_enum));
+
+	g_string_append_c (str, '\n');
+    }
+
+    return g_string_free (str, FALSE);
+}
+
+static XfpmStartupPhase *
+blpm_startup_current_phase (void)
+{
+    guint index;
+
+    if ( startup_done || startup_stack == NULL || startup_stack->len == 0 )
+	return NULL;
+
+    index = g_array_index (startup_stack, guint, startup_stack->len - 1);
+
+    return &g_array_index (startup_phases, XfpmStartupPhase, index);
+}
+
+void blpm_startup_phase_begin (const gchar *phase)
+{
+    XfpmStartupPhase p = { 0, };
+    guint index;
+
+    if ( startup_done )
+	return;
+
+    if ( startup_phases == NULL )
+    {
+	startup_phases = g_array_new (FALSE, FALSE, sizeof (XfpmStartupPhase));
+	startup_stack  = g_array_new (FALSE, FALSE, sizeof (guint));
+	startup_origin = g_get_monotonic_time ();
+    }
+
+    p.name  = phase;
+    p.depth = startup_stack->len;
+    p.begin = g_get_monotonic_time ();
+
+    g_array_append_val (startup_phases, p);
+    index = startup_phases->len - 1;
+    g_array_append_val (startup_stack, index);
+}
+
+void blpm_startup_phase_end (const gchar *phase)
+{
+    XfpmStartupPhase *p;
+    gint64 now;
+
+    now = g_get_monotonic_time ();
+
+    /* close anything left open inside @phase by an early return */
+    while ( (p = blpm_startup_current_phase ()) != NULL )
+    {
+	p->end = now;
+	g_array_set_size (startup_stack, startup_stack->len - 1);
+
+	if ( g_strcmp0 (p->name, phase) == 0 )
+	    break;
+    }
+}
+
+void blpm_startup_count_dbus_call (void)
+{
+    XfpmStartupPhase *p = blpm_startup_current_phase ();
+
+    if ( p != NULL )
+	p->dbus_calls++;
+}
+
+void blpm_startup_count_spawn (void)
+{
+    XfpmStartupPhase *p = blpm_startup_current_phase ();
+
+    if ( p != NULL )
+	p->spawns++;
+}
+
+void blpm_startup_trace_finish (void)
+{
+    XfpmStartupPhase *p;
+    gint64 now;
+
+    now = g_get_monotonic_time ();
+
+    while ( (p = blpm_startup_current_phase ()) != NULL )
+    {
+	p->end = now;
+	g_array_set_size (startup_stack, startup_stack->len - 1);
+    }
+
+    startup_done = TRUE;
+}
+
+/*
+ * One tab separated line per phase, times in milliseconds relative to
+ * the first phase, so traces of different releases can be diffed.
+ */
+gchar *blpm_startup_trace_to_string (void)
+{
+    XfpmStartupPhase *p;
+    GString *str;
+    guint i;
+
+    str = g_string_new ("# phase\tdepth\tstart-ms\tduration-ms\tdbus-calls\tspawns\n");
+
+    if ( startup_phases == NULL )
+	return g_string_free (str, FALSE);
+
+    for ( i = 0; i < startup_phases->len; i++ )
+    {
+	p = &g_array_index (startup_phases, XfpmStartupPhase, i);
+
+	g_string_append_printf (str, "%s\t%u\t%.3f\t%.3f\t%u\t%u\n",
+				p->name, p->depth,
+				(p->begin - startup_origin) / 1000.0,
+				p->end != 0 ? (p->end - p->begin) / 1000.0 : -1.0,
+				p->dbus_calls, p->spawns);
+    }
+
+    return g_string_free (str, FALSE);
 }
@@ -32,14 +32,24 @@ G_BEGIN_DECLS
 
 #if defined(G_HAVE_ISO_VARARGS)
 
+/*
+ * Tested in the macros, so unless debugging or tracing was asked for a
+ * trace costs one well predicted branch and its arguments are not even
+ * evaluated.
+ */
+extern gboolean blpm_debug_enabled;
+
 #define XFPM_DEBUG(...)\
-    blpm_debug (__func__, __FILE__, __LINE__, __VA_ARGS__)
+    G_STMT_START { if ( G_UNLIKELY (blpm_debug_enabled) )\
+	blpm_debug (__func__, __FILE__, __LINE__, __VA_ARGS__); } G_STMT_END
 
 #define XFPM_WARNING(...)\
-    blpm_warn (__func__, __FILE__, __LINE__, __VA_ARGS__)
+    G_STMT_START { if ( G_UNLIKELY (blpm_debug_enabled) )\
+	blpm_warn (__func__, __FILE__, __LINE__, __VA_ARGS__); } G_STMT_END
 
 #define XFPM_DEBUG_ENUM(_value, _type, ...)\
-    blpm_debug_enum (__func__, __FILE__, __LINE__, _value, _type, __VA_ARGS__)
+    G_STMT_START { if ( G_UNLIKELY (blpm_debug_enabled) )\
+	blpm_debug_enum (__func__, __FILE__, __LINE__, _value, _type, __VA_ARGS__); } G_STMT_END
 
 					 
 void		blpm_debug_enum         (const gchar *func,
@@ -70,7 +80,32 @@ void		blpm_warn 		(const char *func,
 
 #endif
 
-void		blpm_debug_init		(gboolean debug);
+/*
+ * With @debug traces are printed to stdout, with @trace they are kept
+ * in a fixed size in-memory ring read back with blpm_trace_to_string().
+ * With neither they are skipped in the macros.
+ */
+void		blpm_debug_init		(gboolean debug,
+					 gboolean trace);
+
+gchar	       *blpm_trace_to_string	(void);
+
+/*
+ * Startup tracing, always compiled in. Phases nest; blocking D-Bus
+ * calls and spawned processes are charged to the innermost open one.
+ * Recording stops for good at blpm_startup_trace_finish().
+ */
+void		blpm_startup_phase_begin	(const gchar *phase);
+
+void		blpm_startup_phase_end		(const gchar *phase);
+
+void		blpm_startup_count_dbus_call	(void);
+
+void		blpm_startup_count_spawn	(void);
+
+void		blpm_startup_trace_finish	(void);
+
+gchar	       *blpm_startup_trace_to_string	(void);
 
 G_END_DECLS
 
@@ -0,0 +1,126 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "blpm-icon-cache.h"
+
+/* enough for every battery/ac/brightness variant in the sizes we use */
+#define XFPM_ICON_CACHE_SIZE	64
+
+typedef struct
+{
+    gchar     *key;
+    GdkPixbuf *pixbuf;
+
+} XfpmIconCacheEntry;
+
+static GHashTable *icon_cache_table = NULL;	/* key -> GList link in icon_cache_lru */
+static GQueue      icon_cache_lru   = G_QUEUE_INIT;	/* most recently used first */
+
+static void
+blpm_icon_cache_entry_free (XfpmIconCacheEntry *entry)
+{
+    g_object_unref (entry->pixbuf);
+    g_free (entry->key);
+    g_slice_free (XfpmIconCacheEntry, entry);
+}
+
+void blpm_icon_cache_clear (void)
+{
+    XfpmIconCacheEntry *entry;
+
+    if ( icon_cache_table == NULL )
+	return;
+
+    g_hash_table_remove_all (icon_cache_table);
+
+    while ( (entry = g_queue_pop_head (&icon_cache_lru)) != NULL )
+	blpm_icon_cache_entry_free (entry);
+}
+
+static void
+blpm_icon_cache_theme_changed_cb (GtkIconTheme *theme, gpointer data)
+{
+    blpm_icon_cache_clear ();
+}
+
+GdkPixbuf *blpm_icon_cache_load (const gchar *icon_name, gint size,
+				 GtkIconLookupFlags flags, GError **error)
+{
+    XfpmIconCacheEntry *entry;
+    GdkPixbuf *pixbuf;
+    GList *link;
+    gchar *key;
+
+    g_return_val_if_fail (icon_name != NULL, NULL);
+
+    if ( icon_cache_table == NULL )
+    {
+	icon_cache_table = g_hash_table_new (g_str_hash, g_str_equal);
+	g_signal_connect (gtk_icon_theme_get_default (), "changed",
+			  G_CALLBACK (blpm_icon_cache_theme_changed_cb), NULL);
+    }
+
+    key = g_strdup_printf ("%s:%d:%u", icon_name, size, (guint) flags);
+
+    link = g_hash_table_lookup (icon_cache_table, key);
+    if ( link != NULL )
+    {
+	g_free (key);
+
+	/* move to the front */
+	g_queue_unlink (&icon_cache_lru, link);
+	g_queue_push_head_link (&icon_cache_lru, link);
+
+	entry = link->data;
+	return g_object_ref (entry->pixbuf);
+    }
+
+    pixbuf = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
+				       icon_name, size, flags, error);
+
+    /* misses are not remembered, the icon may get installed later */
+    if ( pixbuf == NULL )
+    {
+	g_free (key);
+	return NULL;
+    }
+
+    if ( icon_cache_lru.length >= XFPM_ICON_CACHE_SIZE )
+    {
+	entry = g_queue_pop_tail (&icon_cache_lru);
+	g_hash_table_remove (icon_cache_table, entry->key);
+	blpm_icon_cache_entry_free (entry);
+    }
+
+    entry = g_slice_new (XfpmIconCacheEntry);
+    entry->key = key;
+    entry->pixbuf = g_object_ref (pixbuf);
+
+    g_queue_push_head (&icon_cache_lru, entry);
+    g_hash_table_insert (icon_cache_table, entry->key, icon_cache_lru.head);
+
+    return pixbuf;
+}
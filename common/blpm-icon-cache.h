@@ -0,0 +1,42 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __XFPM_ICON_CACHE_H
+#define __XFPM_ICON_CACHE_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Process wide cache of decoded theme icons, dropped when the icon
+ * theme changes. The returned pixbuf is a new reference shared with
+ * the cache, so it must not be modified.
+ */
+GdkPixbuf      *blpm_icon_cache_load		(const gchar *icon_name,
+						 gint size,
+						 GtkIconLookupFlags flags,
+						 GError **error);
+
+void		blpm_icon_cache_clear		(void);
+
+G_END_DECLS
+
+#endif /* __XFPM_ICON_CACHE_H */
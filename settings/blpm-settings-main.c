@@ -173,7 +173,7 @@ int main (int argc, char **argv)
 	    return EXIT_FAILURE;
 	}
 
-	blpm_debug_init (debug);
+	blpm_debug_init (debug, FALSE);
 
 	has_battery = blpm_string_to_bool (g_hash_table_lookup (config_hash, "has-battery"));
 	has_lid = blpm_string_to_bool (g_hash_table_lookup (config_hash, "has-lid"));
@@ -37,6 +37,7 @@
 
 #include "blpm-common.h"
 #include "blpm-icons.h"
+#include "blpm-icon-cache.h"
 #include "blpm-debug.h"
 #include "blpm-power-common.h"
 #include "blpm-power.h"
@@ -51,6 +52,9 @@
 
 #define BRIGHTNESS_DISABLED 	9
 
+/* window in ms over which slider changes are collected before writing */
+#define SETTINGS_WRITE_DELAY	250
+
 static 	GtkBuilder *xml 			= NULL;
 static  GtkWidget  *nt				= NULL;
 
@@ -77,6 +81,11 @@ static  UpClient *upower = NULL;
 
 static gint devices_page_num;
 
+/* Settings write buffer: property -> GValue, flushed as one batch */
+static  GHashTable    *pending_writes       = NULL;
+static  BlconfChannel *pending_channel      = NULL;
+static  guint          pending_writes_id    = 0;
+
 
 enum
 {
@@ -214,24 +223,119 @@ void        light_locker_automatic_locking_changed_cb (GtkWidget *w,
 void        blpm_update_logind_handle_lid_switch   (BlconfChannel *channel);
 /* END Light Locker Integration */
 
+static void
+settings_write_value_free (gpointer data)
+{
+    GValue *value = data;
+
+    g_value_unset (value);
+    g_slice_free (GValue, value);
+}
+
+/*
+ * Write all queued changes. When more than one key is pending the
+ * daemon is told up front which ones follow, so it can apply them
+ * together instead of reacting to each one.
+ */
+static gboolean
+settings_write_flush (gpointer data)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    GString *keys;
+    guint n_writes;
+
+    pending_writes_id = 0;
+
+    if ( pending_writes == NULL || pending_channel == NULL )
+	return FALSE;
+
+    /* a slider dragged back to where it started doesn't need a write */
+    g_hash_table_iter_init (&iter, pending_writes);
+    while ( g_hash_table_iter_next (&iter, &key, &value) )
+    {
+	if ( blconf_channel_get_uint (pending_channel, key, G_MAXUINT) == g_value_get_uint (value) )
+	    g_hash_table_iter_remove (&iter);
+    }
+
+    n_writes = g_hash_table_size (pending_writes);
+
+    if ( n_writes > 1 )
+    {
+	keys = g_string_new (NULL);
+	g_hash_table_iter_init (&iter, pending_writes);
+	while ( g_hash_table_iter_next (&iter, &key, NULL) )
+	{
+	    if ( keys->len > 0 )
+		g_string_append_c (keys, ';');
+	    g_string_append (keys, key);
+	}
+	blconf_channel_set_string (pending_channel, PROPERTIES_PREFIX SETTINGS_BATCH, keys->str);
+	g_string_free (keys, TRUE);
+    }
+
+    g_hash_table_iter_init (&iter, pending_writes);
+    while ( g_hash_table_iter_next (&iter, &key, &value) )
+    {
+	if ( !blconf_channel_set_property (pending_channel, key, value) )
+	{
+	    g_critical ("Cannot set value for property %s\n", (const gchar *) key);
+	}
+    }
+
+    /* the marker is not a setting, don't leave it in the channel */
+    if ( n_writes > 1 )
+	blconf_channel_reset_property (pending_channel, PROPERTIES_PREFIX SETTINGS_BATCH, FALSE);
+
+    g_hash_table_remove_all (pending_writes);
+
+    return FALSE;
+}
+
+/*
+ * Queue an unsigned value for @property, replacing any value queued
+ * earlier for it. @property must be a static string.
+ */
+static void
+settings_write_queue_uint (BlconfChannel *channel, const gchar *property, guint val)
+{
+    GValue *value;
+
+    if ( pending_writes == NULL )
+	pending_writes = g_hash_table_new_full (g_str_hash, g_str_equal,
+						NULL, settings_write_value_free);
+
+    /* a different channel can't share the batch, write out what we have */
+    if ( pending_channel != NULL && pending_channel != channel && pending_writes_id != 0 )
+    {
+	g_source_remove (pending_writes_id);
+	settings_write_flush (NULL);
+    }
+
+    pending_channel = channel;
+
+    value = g_slice_new0 (GValue);
+    g_value_init (value, G_TYPE_UINT);
+    g_value_set_uint (value, val);
+
+    g_hash_table_replace (pending_writes, (gpointer) property, value);
+
+    if ( pending_writes_id == 0 )
+	pending_writes_id = g_timeout_add (SETTINGS_WRITE_DELAY, settings_write_flush, NULL);
+}
+
 void brightness_level_on_ac (GtkWidget *w,  BlconfChannel *channel)
 {
     guint val = (guint) gtk_range_get_value (GTK_RANGE (w));
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_LEVEL_ON_AC, val) )
-    {
-	g_critical ("Unable to set value %u for property %s\n", val, BRIGHTNESS_LEVEL_ON_AC);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_LEVEL_ON_AC, val);
 }
 
 void brightness_level_on_battery (GtkWidget *w,  BlconfChannel *channel)
 {
      guint val = (guint) gtk_range_get_value (GTK_RANGE (w));
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_LEVEL_ON_BATTERY, val) )
-    {
-	g_critical ("Unable to set value %u for property %s\n", val, BRIGHTNESS_LEVEL_ON_BATTERY);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_LEVEL_ON_BATTERY, val);
 }
 
 void
@@ -263,10 +367,7 @@ inactivity_on_ac_value_changed_cb (GtkWidget *widget, BlconfChannel *channel)
 {
     gint value    = (gint)gtk_range_get_value (GTK_RANGE (widget));
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_AC_INACTIVITY_TIMEOUT, value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_AC_INACTIVITY_TIMEOUT);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_AC_INACTIVITY_TIMEOUT, value);
 }
 
 void
@@ -274,10 +375,7 @@ inactivity_on_battery_value_changed_cb (GtkWidget *widget, BlconfChannel *channe
 {
     gint value    = (gint)gtk_range_get_value (GTK_RANGE (widget));
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_BATTERY_INACTIVITY_TIMEOUT, value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_BATTERY_INACTIVITY_TIMEOUT);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_BATTERY_INACTIVITY_TIMEOUT, value);
 }
 
 void
@@ -506,10 +604,7 @@ sleep_on_battery_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_BATT_DPMS_SLEEP, sleep_value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_BATT_DPMS_SLEEP);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_BATT_DPMS_SLEEP, sleep_value);
 }
 
 void
@@ -526,10 +621,7 @@ off_on_battery_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_BATT_DPMS_OFF, off_value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_BATT_DPMS_OFF);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_BATT_DPMS_OFF, off_value);
 }
 
 void
@@ -601,10 +693,7 @@ sleep_on_ac_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
 
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_AC_DPMS_SLEEP, sleep_value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_AC_DPMS_SLEEP);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_AC_DPMS_SLEEP, sleep_value);
 }
 
 void
@@ -624,10 +713,7 @@ off_on_ac_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
 
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX ON_AC_DPMS_OFF, off_value))
-    {
-	g_critical ("Cannot set value for property %s\n", ON_AC_DPMS_OFF);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX ON_AC_DPMS_OFF, off_value);
 }
 
 /*
@@ -719,10 +805,7 @@ brightness_on_battery_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_ON_BATTERY, value))
-    {
-	g_critical ("Cannot set value for property %s\n", BRIGHTNESS_ON_BATTERY);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_ON_BATTERY, value);
 }
 
 void
@@ -739,10 +822,7 @@ brightness_on_ac_value_changed_cb (GtkWidget *w, BlconfChannel *channel)
 	}
     }
 
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_ON_AC, value))
-    {
-	g_critical ("Cannot set value for property %s\n", BRIGHTNESS_ON_AC);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX BRIGHTNESS_ON_AC, value);
 }
 
 gboolean
@@ -812,10 +892,7 @@ critical_level_value_changed_cb (GtkSpinButton *w, BlconfChannel *channel)
 {
     guint val = (guint) gtk_spin_button_get_value (w);
     
-    if (!blconf_channel_set_uint (channel, PROPERTIES_PREFIX CRITICAL_POWER_LEVEL, val) )
-    {
-	g_critical ("Unable to set value %d for property %s\n", val, CRITICAL_POWER_LEVEL);
-    }
+    settings_write_queue_uint (channel, PROPERTIES_PREFIX CRITICAL_POWER_LEVEL, val);
 }
 
 void
@@ -1858,11 +1935,10 @@ update_sideview_icon (UpDevice *device)
     name = get_device_description (upower, device);
     icon_name = get_device_icon_name (upower, device);
 
-    pix = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (),
-                                    icon_name,
-                                    48,
-                                    GTK_ICON_LOOKUP_USE_BUILTIN,
-                                    NULL);
+    pix = blpm_icon_cache_load (icon_name,
+                                48,
+                                GTK_ICON_LOOKUP_USE_BUILTIN,
+                                NULL);
 
     gtk_list_store_set (list_store, iter,
                         COL_SIDEBAR_ICON, pix,
@@ -2238,6 +2314,18 @@ view_cursor_changed_cb (GtkTreeView *view, gpointer *user_data)
 static void
 settings_quit (GtkWidget *widget, BlconfChannel *channel)
 {
+    /* don't lose the last slider movements */
+    if ( pending_writes_id != 0 )
+    {
+	g_source_remove (pending_writes_id);
+	settings_write_flush (NULL);
+    }
+    if ( pending_writes != NULL )
+    {
+	g_hash_table_destroy (pending_writes);
+	pending_writes = NULL;
+    }
+
     g_object_unref (channel);
     blconf_shutdown();
     gtk_widget_destroy (widget);
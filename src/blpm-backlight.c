@@ -61,6 +61,15 @@ static void blpm_backlight_set_property (GObject *object,
 
 #define ALARM_DISABLED 9
 
+/* a restore sooner than this many seconds after dimming counts as a wasted dim */
+#define ADAPTIVE_DIM_QUICK_RESET 5
+
+/* weight of the latest dim in the moving average of wasted dims */
+#define ADAPTIVE_DIM_WEIGHT 0.25
+
+/* the learned rates are written out at most this often, and on exit */
+#define ADAPTIVE_DIM_SAVE_INTERVAL 600
+
 #define XFPM_BACKLIGHT_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_BACKLIGHT, XfpmBacklightPrivate))
 
@@ -73,8 +82,6 @@ struct XfpmBacklightPrivate
     XfpmButton     *button;
     XfpmNotify     *notify;
     
-    NotifyNotification *n;
-    
     gboolean	    has_hw;
     gboolean	    on_battery;
     
@@ -87,6 +94,11 @@ struct XfpmBacklightPrivate
 
     gboolean        dimmed;
     gboolean	    block;
+
+    gint64          dim_time;
+    gdouble         dim_rate[2];
+    gboolean        dim_rate_dirty;
+    guint           dim_rate_save_id;
 };
 
 enum
@@ -107,11 +119,12 @@ blpm_backlight_dim_brightness (XfpmBacklight *backlight)
     
     if (blpm_power_is_in_presentation_mode (backlight->priv->power) == FALSE )
     {
+	const XfpmBlconfSettings *settings;
 	gint32 dim_level;
 	
-	g_object_get (G_OBJECT (backlight->priv->conf),
-		      backlight->priv->on_battery ? BRIGHTNESS_LEVEL_ON_BATTERY : BRIGHTNESS_LEVEL_ON_AC, &dim_level,
-		      NULL);
+	settings = blpm_blconf_get_settings (backlight->priv->conf);
+	dim_level = backlight->priv->on_battery ? settings->brightness_level_on_battery
+						: settings->brightness_level_on_ac;
 	
 	ret = blpm_brightness_get_level (backlight->priv->brightness, &backlight->priv->last_level);
 	
@@ -131,53 +144,23 @@ blpm_backlight_dim_brightness (XfpmBacklight *backlight)
 	{
 	    XFPM_DEBUG ("Current brightness level before dimming : %d, new %d", backlight->priv->last_level, dim_level);
 	    backlight->priv->dimmed = blpm_brightness_set_level (backlight->priv->brightness, dim_level);
+	    if ( backlight->priv->dimmed )
+		backlight->priv->dim_time = g_get_monotonic_time ();
 	}
     }
 }
 
-static gboolean
-blpm_backlight_destroy_popup (gpointer data)
-{
-    XfpmBacklight *backlight;
-    
-    backlight = XFPM_BACKLIGHT (data);
-    
-    if ( backlight->priv->n )
-    {
-	g_object_unref (backlight->priv->n);
-	backlight->priv->n = NULL;
-    }
-    
-    return FALSE;
-}
-
 static void
 blpm_backlight_show_notification (XfpmBacklight *backlight, gfloat value)
 {
     gchar *summary;
 
-    /* create the notification on demand */
-    if ( backlight->priv->n == NULL )
-    {
-	backlight->priv->n = blpm_notify_new_notification (backlight->priv->notify,
-							   "",
-							   "",
-							   "blpm-brightness-lcd",
-							   0,
-							   XFPM_NOTIFY_NORMAL,
-							   NULL);
-    }
-
     /* generate a human-readable summary for the notification */
     summary = g_strdup_printf (_("Brightness: %.0f percent"), value);
-    notify_notification_update (backlight->priv->n, summary, NULL, NULL);
+
+    blpm_notify_show_value (backlight->priv->notify, XFPM_NOTIFY_CATEGORY_BRIGHTNESS,
+			    summary, "blpm-brightness-lcd", value);
     g_free (summary);
-    
-    /* add the brightness value to the notification */
-    notify_notification_set_hint_int32 (backlight->priv->n, "value", value);
-    
-    /* show the notification */
-    notify_notification_show (backlight->priv->n, NULL);
 }
 
 static void
@@ -203,6 +186,94 @@ blpm_backlight_alarm_timeout_cb (EggIdletime *idle, guint id, XfpmBacklight *bac
 	blpm_backlight_dim_brightness (backlight);
 }
 
+static void blpm_backlight_brightness_on_ac_settings_changed      (XfpmBacklight *backlight);
+static void blpm_backlight_brightness_on_battery_settings_changed (XfpmBacklight *backlight);
+
+static void
+blpm_backlight_adaptive_dim_save (XfpmBacklight *backlight)
+{
+    BlconfChannel *channel;
+
+    if ( !backlight->priv->dim_rate_dirty )
+	return;
+
+    XFPM_DEBUG ("Saving wasted dim rates %.2f/%.2f",
+		backlight->priv->dim_rate[0], backlight->priv->dim_rate[1]);
+
+    channel = blpm_blconf_get_channel (backlight->priv->conf);
+    blconf_channel_set_double (channel, PROPERTIES_PREFIX ADAPTIVE_DIM_STATE_ON_AC,
+			       backlight->priv->dim_rate[0]);
+    blconf_channel_set_double (channel, PROPERTIES_PREFIX ADAPTIVE_DIM_STATE_ON_BATTERY,
+			       backlight->priv->dim_rate[1]);
+
+    backlight->priv->dim_rate_dirty = FALSE;
+}
+
+static gboolean
+blpm_backlight_adaptive_dim_save_cb (gpointer data)
+{
+    XfpmBacklight *backlight = data;
+
+    backlight->priv->dim_rate_save_id = 0;
+    blpm_backlight_adaptive_dim_save (backlight);
+
+    return FALSE;
+}
+
+/*
+ * Learn from how fast the user comes back after a dim. The state is a
+ * moving average of the share of dims that got restored almost
+ * immediately; the dim timeout is stretched from the configured one
+ * towards ADAPTIVE_DIM_MAX_TIMEOUT in proportion to it.
+ */
+static void
+blpm_backlight_adaptive_dim_update (XfpmBacklight *backlight)
+{
+    gboolean on_battery;
+    gint64 latency;
+    gdouble *rate;
+
+    if ( !blpm_blconf_get_settings (backlight->priv->conf)->adaptive_dim ||
+	 backlight->priv->dim_time == 0 )
+	return;
+
+    on_battery = backlight->priv->on_battery;
+    latency = (g_get_monotonic_time () - backlight->priv->dim_time) / G_USEC_PER_SEC;
+    rate = &backlight->priv->dim_rate[on_battery ? 1 : 0];
+
+    *rate += ADAPTIVE_DIM_WEIGHT * ((latency < ADAPTIVE_DIM_QUICK_RESET ? 1.0 : 0.0) - *rate);
+
+    XFPM_DEBUG ("Brightness restored %" G_GINT64_FORMAT "s after dimming, wasted dim rate %.2f",
+		latency, *rate);
+
+    /* keep it in memory, a dim is too frequent for a channel write */
+    backlight->priv->dim_rate_dirty = TRUE;
+    if ( backlight->priv->dim_rate_save_id == 0 )
+	backlight->priv->dim_rate_save_id = g_timeout_add_seconds (ADAPTIVE_DIM_SAVE_INTERVAL,
+								   blpm_backlight_adaptive_dim_save_cb,
+								   backlight);
+
+    if ( on_battery )
+	blpm_backlight_brightness_on_battery_settings_changed (backlight);
+    else
+	blpm_backlight_brightness_on_ac_settings_changed (backlight);
+}
+
+static guint
+blpm_backlight_get_dim_timeout (XfpmBacklight *backlight, guint timeout, gboolean on_battery)
+{
+    const XfpmBlconfSettings *settings;
+    guint max_timeout;
+
+    settings = blpm_blconf_get_settings (backlight->priv->conf);
+    max_timeout = settings->adaptive_dim_max_timeout;
+
+    if ( !settings->adaptive_dim || max_timeout <= timeout )
+	return timeout;
+
+    return timeout + (guint) ((max_timeout - timeout) * backlight->priv->dim_rate[on_battery ? 1 : 0]);
+}
+
 static void
 blpm_backlight_reset_cb (EggIdletime *idle, XfpmBacklight *backlight)
 {
@@ -212,13 +283,16 @@ blpm_backlight_reset_cb (EggIdletime *idle, XfpmBacklight *backlight)
 	{
 	    XFPM_DEBUG ("Alarm reset, setting level to %d", backlight->priv->last_level);
 	    blpm_brightness_set_level (backlight->priv->brightness, backlight->priv->last_level);
+	    blpm_backlight_adaptive_dim_update (backlight);
 	}
 	backlight->priv->dimmed = FALSE;
+	backlight->priv->dim_time = 0;
     }
 }
 
+/* negative steps go down */
 static void
-blpm_backlight_button_pressed_cb (XfpmButton *button, XfpmButtonKey type, XfpmBacklight *backlight)
+blpm_backlight_step (XfpmBacklight *backlight, gint steps)
 {
     gint32 level;
     gboolean ret = TRUE;
@@ -230,23 +304,33 @@ blpm_backlight_button_pressed_cb (XfpmButton *button, XfpmButtonKey type, XfpmBa
                   SHOW_BRIGHTNESS_POPUP, &show_popup,
                   NULL);
     
-    if ( type != BUTTON_MON_BRIGHTNESS_UP && type != BUTTON_MON_BRIGHTNESS_DOWN )
-	return; /* sanity check, can this ever happen? */
-
     backlight->priv->block = TRUE;
     if ( !handle_brightness_keys )
         ret = blpm_brightness_get_level (backlight->priv->brightness, &level);
     else
-    {
-	if ( type == BUTTON_MON_BRIGHTNESS_UP )
-	    ret = blpm_brightness_up (backlight->priv->brightness, &level);
-	else
-	    ret = blpm_brightness_down (backlight->priv->brightness, &level);
-    }
+	ret = blpm_brightness_step (backlight->priv->brightness, steps, &level);
     if ( ret && show_popup)
 	blpm_backlight_show (backlight, level);
 }
 
+static void
+blpm_backlight_button_pressed_cb (XfpmButton *button, XfpmButtonKey type, XfpmBacklight *backlight)
+{
+    if ( type == BUTTON_MON_BRIGHTNESS_UP )
+	blpm_backlight_step (backlight, 1);
+    else if ( type == BUTTON_MON_BRIGHTNESS_DOWN )
+	blpm_backlight_step (backlight, -1);
+}
+
+static void
+blpm_backlight_button_repeated_cb (XfpmButton *button, XfpmButtonKey type, guint steps, XfpmBacklight *backlight)
+{
+    if ( type == BUTTON_MON_BRIGHTNESS_UP )
+	blpm_backlight_step (backlight, steps);
+    else if ( type == BUTTON_MON_BRIGHTNESS_DOWN )
+	blpm_backlight_step (backlight, -(gint) steps);
+}
+
 static void
 blpm_backlight_brightness_on_ac_settings_changed (XfpmBacklight *backlight)
 {
@@ -264,6 +348,7 @@ blpm_backlight_brightness_on_ac_settings_changed (XfpmBacklight *backlight)
     }
     else
     {
+	timeout_on_ac = blpm_backlight_get_dim_timeout (backlight, timeout_on_ac, FALSE);
 	egg_idletime_alarm_set (backlight->priv->idle, TIMEOUT_BRIGHTNESS_ON_AC, timeout_on_ac * 1000);
     }
 }
@@ -285,6 +370,7 @@ blpm_backlight_brightness_on_battery_settings_changed (XfpmBacklight *backlight)
     }
     else
     {
+	timeout_on_battery = blpm_backlight_get_dim_timeout (backlight, timeout_on_battery, TRUE);
 	egg_idletime_alarm_set (backlight->priv->idle, TIMEOUT_BRIGHTNESS_ON_BATTERY, timeout_on_battery * 1000);
     } 
 }
@@ -301,6 +387,9 @@ static void
 blpm_backlight_on_battery_changed_cb (XfpmPower *power, gboolean on_battery, XfpmBacklight *backlight)
 {
     backlight->priv->on_battery = on_battery;
+
+    /* the following reset is not the user coming back */
+    backlight->priv->dim_time = 0;
 }
 
 static void
@@ -348,6 +437,9 @@ blpm_backlight_init (XfpmBacklight *backlight)
     backlight->priv->power    = NULL;
     backlight->priv->dimmed = FALSE;
     backlight->priv->block = FALSE;
+    backlight->priv->dim_time = 0;
+    backlight->priv->dim_rate[0] = 0.0;
+    backlight->priv->dim_rate[1] = 0.0;
     backlight->priv->brightness_switch_initialized = FALSE;
     
     if ( !backlight->priv->has_hw )
@@ -358,6 +450,7 @@ blpm_backlight_init (XfpmBacklight *backlight)
     else
     {
 	gboolean ret, handle_keys;
+	gdouble rate;
 
 	backlight->priv->idle   = egg_idletime_new ();
 	backlight->priv->conf   = blpm_blconf_new ();
@@ -426,12 +519,29 @@ blpm_backlight_init (XfpmBacklight *backlight)
 			  
 	g_signal_connect (backlight->priv->button, "button-pressed",
 		          G_CALLBACK (blpm_backlight_button_pressed_cb), backlight);
+
+	g_signal_connect (backlight->priv->button, "button-repeated",
+		          G_CALLBACK (blpm_backlight_button_repeated_cb), backlight);
 			  
 	g_signal_connect_swapped (backlight->priv->conf, "notify::" BRIGHTNESS_ON_AC,
 				  G_CALLBACK (blpm_backlight_brightness_on_ac_settings_changed), backlight);
 	
 	g_signal_connect_swapped (backlight->priv->conf, "notify::" BRIGHTNESS_ON_BATTERY,
 				  G_CALLBACK (blpm_backlight_brightness_on_battery_settings_changed), backlight);
+
+	g_signal_connect_swapped (backlight->priv->conf, "notify::" ADAPTIVE_DIM,
+				  G_CALLBACK (blpm_backlight_set_timeouts), backlight);
+
+	g_signal_connect_swapped (backlight->priv->conf, "notify::" ADAPTIVE_DIM_MAX_TIMEOUT,
+				  G_CALLBACK (blpm_backlight_set_timeouts), backlight);
+
+	/* restore what adaptive dimming learned in earlier sessions */
+	rate = blconf_channel_get_double (blpm_blconf_get_channel (backlight->priv->conf),
+					  PROPERTIES_PREFIX ADAPTIVE_DIM_STATE_ON_AC, 0.0);
+	backlight->priv->dim_rate[0] = CLAMP (rate, 0.0, 1.0);
+	rate = blconf_channel_get_double (blpm_blconf_get_channel (backlight->priv->conf),
+					  PROPERTIES_PREFIX ADAPTIVE_DIM_STATE_ON_BATTERY, 0.0);
+	backlight->priv->dim_rate[1] = CLAMP (rate, 0.0, 1.0);
 				
 	g_signal_connect (backlight->priv->power, "on-battery-changed",
 			  G_CALLBACK (blpm_backlight_on_battery_changed_cb), backlight);
@@ -506,13 +616,16 @@ blpm_backlight_finalize (GObject *object)
 
     backlight = XFPM_BACKLIGHT (object);
 
-    blpm_backlight_destroy_popup (backlight);
-
     if ( backlight->priv->idle )
 	g_object_unref (backlight->priv->idle);
 
+    if ( backlight->priv->dim_rate_save_id != 0 )
+	g_source_remove (backlight->priv->dim_rate_save_id);
+
     if ( backlight->priv->conf )
     {
+    blpm_backlight_adaptive_dim_save (backlight);
+
     /* restore video module brightness switch setting */
     if ( backlight->priv->brightness_switch_save != -1 )
     {
@@ -564,3 +677,43 @@ gboolean blpm_backlight_has_hw (XfpmBacklight *backlight)
 {
     return backlight->priv->has_hw;
 }
+
+gboolean blpm_backlight_get_level (XfpmBacklight *backlight, gint32 *level)
+{
+    g_return_val_if_fail (XFPM_IS_BACKLIGHT (backlight), FALSE);
+
+    if ( !backlight->priv->has_hw )
+	return FALSE;
+
+    /* don't hand out the dimmed level, that's not what the user set */
+    if ( backlight->priv->dimmed )
+    {
+	*level = backlight->priv->last_level;
+	return TRUE;
+    }
+
+    return blpm_brightness_get_level (backlight->priv->brightness, level);
+}
+
+/*
+ * Puts back a level read with blpm_backlight_get_level, quietly: no
+ * notification and no brightness switch handling.
+ */
+void blpm_backlight_restore_level (XfpmBacklight *backlight, gint32 level)
+{
+    gint32 current;
+
+    g_return_if_fail (XFPM_IS_BACKLIGHT (backlight));
+
+    if ( !backlight->priv->has_hw )
+	return;
+
+    backlight->priv->dimmed = FALSE;
+    backlight->priv->last_level = level;
+
+    if ( blpm_brightness_get_level (backlight->priv->brightness, &current) && current == level )
+	return;
+
+    XFPM_DEBUG ("Restoring brightness level %d", level);
+    blpm_brightness_set_level (backlight->priv->brightness, level);
+}
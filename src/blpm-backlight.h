@@ -50,6 +50,12 @@ XfpmBacklight       	       *blpm_backlight_new              (void);
 
 gboolean			blpm_backlight_has_hw		(XfpmBacklight *backlight);
 
+gboolean			blpm_backlight_get_level	(XfpmBacklight *backlight,
+								 gint32 *level);
+
+void				blpm_backlight_restore_level	(XfpmBacklight *backlight,
+								 gint32 level);
+
 G_END_DECLS
 
 #endif /* __XFPM_BACKLIGHT_H */
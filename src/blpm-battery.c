@@ -278,7 +278,6 @@ blpm_battery_notify_idle (gpointer data)
 static void
 blpm_battery_notify_state (XfpmBattery *battery)
 {
-    gboolean notify;
     static gboolean starting_up = TRUE;
 
     if ( battery->priv->type == UP_DEVICE_KIND_BATTERY ||
@@ -290,11 +289,7 @@ blpm_battery_notify_state (XfpmBattery *battery)
 	    return;
 	}
 
-	g_object_get (G_OBJECT (battery->priv->conf),
-		      GENERAL_NOTIFICATION_CFG, &notify,
-		      NULL);
-
-	if ( notify )
+	if ( blpm_blconf_get_settings (battery->priv->conf)->general_notification )
 	{
 	    if (battery->priv->notify_idle == 0)
 	        battery->priv->notify_idle = g_idle_add (blpm_battery_notify_idle, battery);
@@ -308,10 +303,7 @@ blpm_battery_check_charge (XfpmBattery *battery)
     XfpmBatteryCharge charge;
     guint critical_level, low_level;
 
-    g_object_get (G_OBJECT (battery->priv->conf),
-		  CRITICAL_POWER_LEVEL, &critical_level,
-		  NULL);
-
+    critical_level = blpm_blconf_get_settings (battery->priv->conf)->critical_power_level;
     low_level = critical_level + 10;
 
     if ( battery->priv->percentage > low_level )
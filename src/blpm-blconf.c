@@ -50,8 +50,18 @@ struct XfpmBlconfPrivate
     BlconfChannel 	*channel;
     BlconfChannel   *session_channel;
     GValue              *values;
+
+    XfpmBlconfSettings   pending;
+    XfpmBlconfSettings  *settings;
+    gboolean             loading;
+
+    GHashTable          *batch_keys;	/* keys of the batch not seen yet */
+    guint                batch_timeout_id;
 };
 
+/* give up on a settings batch whose keys never all arrive */
+#define XFPM_BLCONF_BATCH_TIMEOUT	1000
+
 enum
 {
     PROP_0,
@@ -84,6 +94,8 @@ enum
     PROP_IDLE_SLEEP_MODE_ON_BATTERY,
     PROP_DIM_ON_AC_TIMEOUT,
     PROP_DIM_ON_BATTERY_TIMEOUT,
+    PROP_ADAPTIVE_DIM,
+    PROP_ADAPTIVE_DIM_MAX_TIMEOUT,
 #ifdef WITH_NETWORK_MANAGER
     PROP_NETWORK_MANAGER_SLEEP,
 #endif
@@ -94,8 +106,131 @@ enum
     N_PROPERTIES
 };
 
+#define SETTINGS_OFFSET(field) G_STRUCT_OFFSET (XfpmBlconfSettings, field)
+
+/* where each property lands in XfpmBlconfSettings */
+static const gsize blpm_blconf_settings_offsets [N_PROPERTIES] =
+{
+    [PROP_GENERAL_NOTIFICATION]        = SETTINGS_OFFSET (general_notification),
+    [PROP_LOCK_SCREEN_ON_SLEEP]        = SETTINGS_OFFSET (lock_screen_on_sleep),
+    [PROP_CRITICAL_LEVEL]              = SETTINGS_OFFSET (critical_power_level),
+    [PROP_SHOW_BRIGHTNESS_POPUP]       = SETTINGS_OFFSET (show_brightness_popup),
+    [PROP_HANDLE_BRIGHTNESS_KEYS]      = SETTINGS_OFFSET (handle_brightness_keys),
+    [PROP_TRAY_ICON]                   = SETTINGS_OFFSET (show_tray_icon),
+    [PROP_CRITICAL_BATTERY_ACTION]     = SETTINGS_OFFSET (critical_power_action),
+    [PROP_POWER_BUTTON]                = SETTINGS_OFFSET (power_button_action),
+    [PROP_HIBERNATE_BUTTON]            = SETTINGS_OFFSET (hibernate_button_action),
+    [PROP_SLEEP_BUTTON]                = SETTINGS_OFFSET (sleep_button_action),
+    [PROP_LID_ACTION_ON_AC]            = SETTINGS_OFFSET (lid_action_on_ac),
+    [PROP_LID_ACTION_ON_BATTERY]       = SETTINGS_OFFSET (lid_action_on_battery),
+    [PROP_BRIGHTNESS_LEVEL_ON_AC]      = SETTINGS_OFFSET (brightness_level_on_ac),
+    [PROP_BRIGHTNESS_LEVEL_ON_BATTERY] = SETTINGS_OFFSET (brightness_level_on_battery),
+    [PROP_BRIGHTNESS_SLIDER_MIN_LEVEL] = SETTINGS_OFFSET (brightness_slider_min_level),
+    [PROP_ENABLE_DPMS]                 = SETTINGS_OFFSET (dpms_enabled),
+    [PROP_DPMS_SLEEP_ON_AC]            = SETTINGS_OFFSET (dpms_on_ac_sleep),
+    [PROP_DPMS_OFF_ON_AC]              = SETTINGS_OFFSET (dpms_on_ac_off),
+    [PROP_DPMS_SLEEP_ON_BATTERY]       = SETTINGS_OFFSET (dpms_on_battery_sleep),
+    [PROP_DPMS_OFF_ON_BATTERY]         = SETTINGS_OFFSET (dpms_on_battery_off),
+    [PROP_DPMS_SLEEP_MODE]             = SETTINGS_OFFSET (dpms_sleep_mode),
+    [PROP_IDLE_ON_AC]                  = SETTINGS_OFFSET (inactivity_on_ac),
+    [PROP_IDLE_ON_BATTERY]             = SETTINGS_OFFSET (inactivity_on_battery),
+    [PROP_IDLE_SLEEP_MODE_ON_AC]       = SETTINGS_OFFSET (inactivity_sleep_mode_on_ac),
+    [PROP_IDLE_SLEEP_MODE_ON_BATTERY]  = SETTINGS_OFFSET (inactivity_sleep_mode_on_battery),
+    [PROP_DIM_ON_AC_TIMEOUT]           = SETTINGS_OFFSET (brightness_on_ac),
+    [PROP_DIM_ON_BATTERY_TIMEOUT]      = SETTINGS_OFFSET (brightness_on_battery),
+    [PROP_ADAPTIVE_DIM]                = SETTINGS_OFFSET (adaptive_dim),
+    [PROP_ADAPTIVE_DIM_MAX_TIMEOUT]    = SETTINGS_OFFSET (adaptive_dim_max_timeout),
+#ifdef WITH_NETWORK_MANAGER
+    [PROP_NETWORK_MANAGER_SLEEP]       = SETTINGS_OFFSET (network_manager_sleep),
+#endif
+    [PROP_LOGIND_HANDLE_POWER_KEY]     = SETTINGS_OFFSET (logind_handle_power_key),
+    [PROP_LOGIND_HANDLE_SUSPEND_KEY]   = SETTINGS_OFFSET (logind_handle_suspend_key),
+    [PROP_LOGIND_HANDLE_HIBERNATE_KEY] = SETTINGS_OFFSET (logind_handle_hibernate_key),
+    [PROP_LOGIND_HANDLE_LID_SWITCH]    = SETTINGS_OFFSET (logind_handle_lid_switch),
+};
+
+#undef SETTINGS_OFFSET
+
+#define SESSION_LOCK_SCREEN "/shutdown/LockScreen"
+
+typedef enum
+{
+    XFPM_BLCONF_ROUTE_PROPERTY,		/* one of our properties */
+    XFPM_BLCONF_ROUTE_SESSION_LOCK,	/* xfce4-session lock screen setting */
+    XFPM_BLCONF_ROUTE_BATCH		/* settings dialog batch marker */
+
+} XfpmBlconfRouteClass;
+
+typedef struct
+{
+    XfpmBlconfRouteClass  route;
+    GParamSpec           *pspec;
+
+} XfpmBlconfRoute;
+
+static GHashTable *blpm_blconf_key_table = NULL;
+
 G_DEFINE_TYPE(XfpmBlconf, blpm_blconf, G_TYPE_OBJECT)
 
+static void
+blpm_blconf_settings_store (XfpmBlconfSettings *settings, guint prop_id, const GValue *value)
+{
+    gpointer field;
+
+    field = G_STRUCT_MEMBER_P (settings, blpm_blconf_settings_offsets[prop_id]);
+
+    switch ( G_VALUE_TYPE (value) )
+    {
+	case G_TYPE_BOOLEAN:
+	    *(gboolean *) field = g_value_get_boolean (value);
+	    break;
+	case G_TYPE_UINT:
+	    *(guint *) field = g_value_get_uint (value);
+	    break;
+	case G_TYPE_INT:
+	    *(gint *) field = g_value_get_int (value);
+	    break;
+	case G_TYPE_STRING:
+	    g_free (*(gchar **) field);
+	    *(gchar **) field = g_value_dup_string (value);
+	    break;
+	default:
+	    g_warn_if_reached ();
+	    break;
+    }
+}
+
+static gboolean
+blpm_blconf_settings_free (gpointer data)
+{
+    XfpmBlconfSettings *settings = data;
+
+    g_free (settings->dpms_sleep_mode);
+    g_slice_free (XfpmBlconfSettings, settings);
+
+    return FALSE;
+}
+
+/*
+ * Swap in a fresh copy of the pending settings. The old snapshot is
+ * retired from an idle callback, so a reader holding it further up the
+ * stack never sees it freed.
+ */
+static void
+blpm_blconf_settings_publish (XfpmBlconf *conf)
+{
+    XfpmBlconfSettings *settings, *old;
+
+    settings = g_slice_dup (XfpmBlconfSettings, &conf->priv->pending);
+    settings->dpms_sleep_mode = g_strdup (conf->priv->pending.dpms_sleep_mode);
+
+    old = g_atomic_pointer_get (&conf->priv->settings);
+    g_atomic_pointer_set (&conf->priv->settings, settings);
+
+    if ( old != NULL )
+	g_idle_add (blpm_blconf_settings_free, old);
+}
+
 static void 
 blpm_blconf_set_property (GObject *object,
 			  guint prop_id,
@@ -113,11 +248,15 @@ blpm_blconf_set_property (GObject *object,
     {
 	g_value_init (dst, pspec->value_type);
 	g_param_value_set_default (pspec, dst);
+	blpm_blconf_settings_store (&conf->priv->pending, prop_id, dst);
     }
     
     if ( g_param_values_cmp (pspec, value, dst) != 0)
     {
 	g_value_copy (value, dst);
+	blpm_blconf_settings_store (&conf->priv->pending, prop_id, dst);
+	if ( !conf->priv->loading )
+	    blpm_blconf_settings_publish (conf);
 	g_object_notify (object, pspec->name);
     }
 }
@@ -141,80 +280,186 @@ blpm_blconf_get_property (GObject *object,
 	g_param_value_set_default (pspec, value);
 }
 
+static void
+blpm_blconf_apply_value (XfpmBlconf *conf, GParamSpec *pspec, const GValue *stored)
+{
+    GValue value = { 0, };
+
+    g_value_init (&value, pspec->value_type);
+    if ( g_value_transform (stored, &value) )
+    {
+	g_param_value_validate (pspec, &value);
+	blpm_blconf_set_property (G_OBJECT (conf), pspec->param_id, &value, pspec);
+    }
+    g_value_unset (&value);
+}
+
 static void
 blpm_blconf_load (XfpmBlconf *conf, gboolean channel_valid)
 {
     GParamSpec **specs;
+    XfpmBlconfRoute *route;
+    GHashTable *props = NULL;
+    GHashTableIter iter;
+    gpointer key, stored;
     GValue value = { 0, };
     guint nspecs;
     guint i;
-    
+
+    /* publish a single snapshot once everything is loaded */
+    conf->priv->loading = TRUE;
+
+    /* one round trip for the whole subtree instead of one per setting */
+    if ( channel_valid )
+	props = blconf_channel_get_properties (conf->priv->channel, "/" XFPM_CHANNEL_CFG);
+
+    if ( props != NULL )
+    {
+	g_hash_table_iter_init (&iter, props);
+	while ( g_hash_table_iter_next (&iter, &key, &stored) )
+	{
+	    route = g_hash_table_lookup (blpm_blconf_key_table, key);
+	    if ( route != NULL && route->route == XFPM_BLCONF_ROUTE_PROPERTY )
+		blpm_blconf_apply_value (conf, route->pspec, stored);
+	}
+	g_hash_table_destroy (props);
+    }
+
+    /* whatever is not in the channel gets its default */
     specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (conf), &nspecs);
-    
+
     for ( i = 0; i < nspecs; i++)
     {
-	gchar *prop_name;
-	prop_name = g_strdup_printf ("%s%s", PROPERTIES_PREFIX, specs[i]->name);
+	if ( G_IS_VALUE (conf->priv->values + specs[i]->param_id) )
+	    continue;
+
+	XFPM_DEBUG ("Using default configuration for %s", specs[i]->name);
 	g_value_init (&value, specs[i]->value_type);
-	
-	if (channel_valid)
-	{
-	    if ( !blconf_channel_get_property (conf->priv->channel, prop_name, &value) )
-	    {
-		XFPM_DEBUG ("Using default configuration for %s", specs[i]->name);
-		g_param_value_set_default (specs[i], &value);
-	    }
-	}
-	else
-	{
-	    XFPM_DEBUG ("Using default configuration for %s", specs[i]->name);
-	    g_param_value_set_default (specs[i], &value);
-	}
-	g_free (prop_name);
-	g_object_set_property (G_OBJECT (conf), specs[i]->name, &value);
+	g_param_value_set_default (specs[i], &value);
+	blpm_blconf_set_property (G_OBJECT (conf), specs[i]->param_id, &value, specs[i]);
 	g_value_unset (&value);
     }
     g_free (specs);
+
+    conf->priv->loading = FALSE;
+    blpm_blconf_settings_publish (conf);
+}
+
+static void
+blpm_blconf_batch_end (XfpmBlconf *conf)
+{
+    if ( conf->priv->batch_timeout_id != 0 )
+    {
+	g_source_remove (conf->priv->batch_timeout_id);
+	conf->priv->batch_timeout_id = 0;
+    }
+
+    g_hash_table_remove_all (conf->priv->batch_keys);
+    conf->priv->loading = FALSE;
+    blpm_blconf_settings_publish (conf);
+
+    /* listeners see the whole batch at once */
+    g_object_thaw_notify (G_OBJECT (conf));
+}
+
+static gboolean
+blpm_blconf_batch_timeout_cb (gpointer data)
+{
+    XfpmBlconf *conf = data;
+
+    XFPM_WARNING ("%u key(s) of settings batch never arrived",
+		  g_hash_table_size (conf->priv->batch_keys));
+
+    conf->priv->batch_timeout_id = 0;
+    blpm_blconf_batch_end (conf);
+
+    return FALSE;
+}
+
+/*
+ * The settings dialog announces which keys it is about to write, as a
+ * ';' separated list. Hold back notifications and the settings snapshot
+ * until they have all been applied, so consumers refresh once per batch.
+ */
+static void
+blpm_blconf_batch_begin (XfpmBlconf *conf, const gchar *keys)
+{
+    gchar **names;
+    guint i;
+
+    names = g_strsplit (keys, ";", -1);
+
+    if ( names[0] == NULL )
+    {
+	g_strfreev (names);
+	return;
+    }
+
+    if ( g_hash_table_size (conf->priv->batch_keys) == 0 )
+    {
+	g_object_freeze_notify (G_OBJECT (conf));
+	conf->priv->loading = TRUE;
+    }
+    else
+    {
+	g_source_remove (conf->priv->batch_timeout_id);
+    }
+
+    /* the table takes the strings, only the vector is freed */
+    for ( i = 0; names[i] != NULL; i++ )
+	g_hash_table_replace (conf->priv->batch_keys, names[i], NULL);
+    g_free (names);
+
+    XFPM_DEBUG ("Settings batch of %u key(s)", g_hash_table_size (conf->priv->batch_keys));
+
+    conf->priv->batch_timeout_id = g_timeout_add (XFPM_BLCONF_BATCH_TIMEOUT,
+						  blpm_blconf_batch_timeout_cb, conf);
 }
 
 static void
 blpm_blconf_property_changed_cb (BlconfChannel *channel, gchar *property,
 				 GValue *value, XfpmBlconf *conf)
 {
+    XfpmBlconfRoute *route;
+
     /*FIXME: Set default for this key*/
     if ( G_VALUE_TYPE(value) == G_TYPE_INVALID )
         return;
 
-    if ( !g_str_has_prefix (property, PROPERTIES_PREFIX) || strlen (property) <= strlen (PROPERTIES_PREFIX) )
-	return;
+    route = g_hash_table_lookup (blpm_blconf_key_table, property);
 
-    /* We handle presentation mode and blank-times in blpm-power directly */
-    if ( g_strcmp0 (property, PROPERTIES_PREFIX PRESENTATION_MODE) == 0 ||
-         g_strcmp0 (property, PROPERTIES_PREFIX ON_AC_BLANK) == 0 ||
-         g_strcmp0 (property, PROPERTIES_PREFIX ON_BATTERY_BLANK) == 0)
-        return;
+    if ( route != NULL && route->route == XFPM_BLCONF_ROUTE_BATCH )
+    {
+	if ( G_VALUE_HOLDS_STRING (value) )
+	    blpm_blconf_batch_begin (conf, g_value_get_string (value));
+	return;
+    }
 
-    /* We handle brightness switch in blpm-backlight directly */
-    if ( g_strcmp0 (property, PROPERTIES_PREFIX BRIGHTNESS_SWITCH) == 0 ||
-         g_strcmp0 (property, PROPERTIES_PREFIX BRIGHTNESS_SWITCH_SAVE) == 0 )
-        return;
+    /* keys that are not our properties are watched elsewhere, or not at all */
+    if ( route != NULL && route->route == XFPM_BLCONF_ROUTE_PROPERTY )
+    {
+	XFPM_DEBUG ("Property modified: %s\n", property);
+	blpm_blconf_apply_value (conf, route->pspec, value);
+    }
 
-    XFPM_DEBUG ("Property modified: %s\n", property);
-    
-    g_object_set_property (G_OBJECT (conf), property + strlen (PROPERTIES_PREFIX), value);
+    /* only the announced keys complete a batch, not our own writes */
+    if ( g_hash_table_remove (conf->priv->batch_keys, property) &&
+	 g_hash_table_size (conf->priv->batch_keys) == 0 )
+	blpm_blconf_batch_end (conf);
 }
 
 static void
 blpm_xfsession_property_changed_cb (BlconfChannel *channel, gchar *property,
 				 GValue *value, XfpmBlconf *conf)
 {
+    XfpmBlconfRoute *route;
+
     /*FIXME: Set default for this key*/
     if ( G_VALUE_TYPE(value) == G_TYPE_INVALID )
         return;
 
-    XFPM_DEBUG ("property %s\n", property);
-
-    if ( g_strcmp0 (property, "/shutdown/LockScreen") != 0)
+    route = g_hash_table_lookup (blpm_blconf_key_table, property);
+    if ( route == NULL || route->route != XFPM_BLCONF_ROUTE_SESSION_LOCK )
         return;
 
     /* sanity check */
@@ -229,6 +474,39 @@ blpm_xfsession_property_changed_cb (BlconfChannel *channel, gchar *property,
                              g_value_get_boolean(value));
 }
 
+static void
+blpm_blconf_add_route (const gchar *key, XfpmBlconfRouteClass route_class, GParamSpec *pspec)
+{
+    XfpmBlconfRoute *route;
+
+    route = g_new (XfpmBlconfRoute, 1);
+    route->route = route_class;
+    route->pspec = pspec;
+
+    g_hash_table_insert (blpm_blconf_key_table, (gpointer) key, route);
+}
+
+static void
+blpm_blconf_build_key_table (GObjectClass *object_class)
+{
+    GParamSpec **specs;
+    guint nspecs;
+    guint i;
+
+    blpm_blconf_key_table = g_hash_table_new (g_str_hash, g_str_equal);
+
+    specs = g_object_class_list_properties (object_class, &nspecs);
+
+    /* the class is never unloaded, so neither are the keys */
+    for ( i = 0; i < nspecs; i++)
+	blpm_blconf_add_route (g_strconcat (PROPERTIES_PREFIX, specs[i]->name, NULL),
+			       XFPM_BLCONF_ROUTE_PROPERTY, specs[i]);
+    g_free (specs);
+
+    blpm_blconf_add_route (SESSION_LOCK_SCREEN, XFPM_BLCONF_ROUTE_SESSION_LOCK, NULL);
+    blpm_blconf_add_route (PROPERTIES_PREFIX SETTINGS_BATCH, XFPM_BLCONF_ROUTE_BATCH, NULL);
+}
+
 static void
 blpm_blconf_class_init (XfpmBlconfClass *klass)
 {
@@ -531,6 +809,27 @@ blpm_blconf_class_init (XfpmBlconfClass *klass)
 							120,
                                                         G_PARAM_READWRITE));
 
+    /**
+     * XfpmBlconf::adaptive-dim
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_ADAPTIVE_DIM,
+                                     g_param_spec_boolean (ADAPTIVE_DIM,
+                                                           NULL, NULL,
+                                                           FALSE,
+                                                           G_PARAM_READWRITE));
+
+    /**
+     * XfpmBlconf::adaptive-dim-max-timeout
+     **/
+    g_object_class_install_property (object_class,
+                                     PROP_ADAPTIVE_DIM_MAX_TIMEOUT,
+                                     g_param_spec_uint (ADAPTIVE_DIM_MAX_TIMEOUT,
+                                                        NULL, NULL,
+							10,
+							G_MAXUINT16,
+							600,
+                                                        G_PARAM_READWRITE));
 
     /**
      * XfpmBlconf::brightness-slider-min-level
@@ -597,6 +896,8 @@ blpm_blconf_class_init (XfpmBlconfClass *klass)
                                                            G_PARAM_READWRITE));
 
     g_type_class_add_private (klass, sizeof (XfpmBlconfPrivate));
+
+    blpm_blconf_build_key_table (object_class);
 }
 
 static void
@@ -609,6 +910,9 @@ blpm_blconf_init (XfpmBlconf *conf)
     conf->priv = XFPM_BLCONF_GET_PRIVATE (conf);
     
     conf->priv->values = g_new0 (GValue, N_PROPERTIES);
+    conf->priv->settings = NULL;
+    conf->priv->loading = FALSE;
+    conf->priv->batch_keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     
     if ( !blconf_init (&error) )
     {
@@ -622,10 +926,10 @@ blpm_blconf_init (XfpmBlconf *conf)
     conf->priv->session_channel = blconf_channel_new ("xfce4-session");
 
     /* if xfce4-session is around, sync to it on startup */
-    if ( blconf_channel_has_property (conf->priv->session_channel, "/shutdown/LockScreen") )
+    if ( blconf_channel_has_property (conf->priv->session_channel, SESSION_LOCK_SCREEN) )
     {
         lock_screen = blconf_channel_get_bool (conf->priv->session_channel,
-                                               "/shutdown/LockScreen",
+                                               SESSION_LOCK_SCREEN,
                                                TRUE);
 
         XFPM_DEBUG("lock screen %s", lock_screen ? "TRUE" : "FALSE");
@@ -652,6 +956,11 @@ blpm_blconf_finalize(GObject *object)
     guint i;
     
     conf = XFPM_BLCONF(object);
+
+    if ( conf->priv->batch_timeout_id != 0 )
+	g_source_remove (conf->priv->batch_timeout_id);
+
+    g_hash_table_destroy (conf->priv->batch_keys);
     
     for ( i = 0; i < N_PROPERTIES; i++)
     {
@@ -660,6 +969,10 @@ blpm_blconf_finalize(GObject *object)
     }
     
     g_free (conf->priv->values);
+
+    g_free (conf->priv->pending.dpms_sleep_mode);
+    if ( conf->priv->settings != NULL )
+	blpm_blconf_settings_free (conf->priv->settings);
     
     if (conf->priv->channel )
 	g_object_unref (conf->priv->channel);
@@ -681,8 +994,10 @@ blpm_blconf_new (void)
     } 
     else
     {
+	blpm_startup_phase_begin ("blconf");
 	blpm_blconf_object = g_object_new (XFPM_TYPE_BLCONF, NULL);
 	g_object_add_weak_pointer (blpm_blconf_object, &blpm_blconf_object);
+	blpm_startup_phase_end ("blconf");
     }
     return XFPM_BLCONF (blpm_blconf_object);
 }
@@ -691,3 +1006,14 @@ BlconfChannel *blpm_blconf_get_channel (XfpmBlconf *conf)
 {
     return conf->priv->channel;
 }
+
+/**
+ * blpm_blconf_get_settings:
+ *
+ * Returns the current settings snapshot, see XfpmBlconfSettings.
+ **/
+const XfpmBlconfSettings *
+blpm_blconf_get_settings (XfpmBlconf *conf)
+{
+    return g_atomic_pointer_get (&conf->priv->settings);
+}
@@ -32,6 +32,55 @@ G_BEGIN_DECLS
 
 typedef struct  XfpmBlconfPrivate XfpmBlconfPrivate;
 
+/**
+ * XfpmBlconfSettings:
+ *
+ * Plain copy of every setting, one field per XfpmBlconf property. A new
+ * snapshot is published before the property is notified. Snapshots are
+ * immutable; a retired one stays valid until the main loop next goes
+ * idle, so don't keep the pointer beyond the current callback.
+ **/
+typedef struct
+{
+    gboolean		  general_notification;
+    gboolean		  lock_screen_on_sleep;
+    guint		  critical_power_level;
+    gboolean		  show_brightness_popup;
+    gboolean		  handle_brightness_keys;
+    guint		  show_tray_icon;
+    guint		  critical_power_action;
+    guint		  power_button_action;
+    guint		  hibernate_button_action;
+    guint		  sleep_button_action;
+    guint		  lid_action_on_ac;
+    guint		  lid_action_on_battery;
+    guint		  brightness_level_on_ac;
+    guint		  brightness_level_on_battery;
+    gint		  brightness_slider_min_level;
+
+    gboolean		  dpms_enabled;
+    guint		  dpms_on_ac_sleep;
+    guint		  dpms_on_ac_off;
+    guint		  dpms_on_battery_sleep;
+    guint		  dpms_on_battery_off;
+    gchar		 *dpms_sleep_mode;
+
+    guint		  inactivity_on_ac;
+    guint		  inactivity_on_battery;
+    guint		  inactivity_sleep_mode_on_ac;
+    guint		  inactivity_sleep_mode_on_battery;
+    guint		  brightness_on_ac;
+    guint		  brightness_on_battery;
+    gboolean		  adaptive_dim;
+    guint		  adaptive_dim_max_timeout;
+    gboolean		  network_manager_sleep;
+    gboolean		  logind_handle_power_key;
+    gboolean		  logind_handle_suspend_key;
+    gboolean		  logind_handle_hibernate_key;
+    gboolean		  logind_handle_lid_switch;
+
+} XfpmBlconfSettings;
+
 typedef struct
 {
     GObject		  parent;
@@ -51,6 +100,8 @@ XfpmBlconf       	 *blpm_blconf_new                 	(void);
 
 BlconfChannel 		 *blpm_blconf_get_channel		(XfpmBlconf *conf);
 
+const XfpmBlconfSettings *blpm_blconf_get_settings		(XfpmBlconf *conf);
+
 G_END_DECLS
 
 #endif /* __XFPM_BLCONF_H */
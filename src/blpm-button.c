@@ -50,6 +50,7 @@
 #include "blpm-button.h"
 #include "blpm-enum.h"
 #include "blpm-enum-types.h"
+#include "blpm-marshal.h"
 #include "blpm-debug.h"
 
 static void blpm_button_finalize   (GObject *object);
@@ -57,11 +58,29 @@ static void blpm_button_finalize   (GObject *object);
 #define XFPM_BUTTON_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE((o), XFPM_TYPE_BUTTON, XfpmButtonPrivate))
 
-static struct
+/* Indexed by X keycode (8-255), BUTTON_UNKNOWN for the keys we don't grab */
+static XfpmButtonKey blpm_keycode_map [256] = { BUTTON_UNKNOWN, };
+
+/* Keys whose handlers go to the brightness backends, their auto-repeats are collapsed */
+#define XFPM_BUTTON_KEY_REPEATS(key)			\
+    ((key) == BUTTON_MON_BRIGHTNESS_UP   ||		\
+     (key) == BUTTON_MON_BRIGHTNESS_DOWN ||		\
+     (key) == BUTTON_KBD_BRIGHTNESS_UP   ||		\
+     (key) == BUTTON_KBD_BRIGHTNESS_DOWN)
+
+/* Shortest gap between two dispatches of the same key, in ms */
+#define XFPM_BUTTON_REPEAT_INTERVAL 50
+
+typedef struct
 {
+    XfpmButton      *button;
     XfpmButtonKey    key;
-    guint            key_code;
-} blpm_key_map [NUMBER_OF_BUTTONS] = { {0, 0}, };
+    
+    gint64           last_dispatch;	/* monotonic, in us */
+    gint64           cost;		/* time the handlers took last time, in us */
+    guint            steps;		/* presses held back since */
+    guint            flush_id;
+} XfpmButtonRepeat;
 
 struct XfpmButtonPrivate
 {
@@ -69,11 +88,14 @@ struct XfpmButtonPrivate
     GdkWindow   *window;
     
     guint8       mapped_buttons;
+    
+    XfpmButtonRepeat repeat [NUMBER_OF_BUTTONS];
 };
 
 enum
 {
     BUTTON_PRESSED,
+    BUTTON_REPEATED,
     LAST_SIGNAL
 };
 
@@ -83,41 +105,88 @@ static guint signals[LAST_SIGNAL] = { 0 };
 
 G_DEFINE_TYPE(XfpmButton, blpm_button, G_TYPE_OBJECT)
 
-static guint
-blpm_button_get_key (unsigned int keycode)
+static void
+blpm_button_dispatch (XfpmButton *button, XfpmButtonKey key, guint steps)
 {
-    XfpmButtonKey key = BUTTON_UNKNOWN;
-    guint i;
+    XfpmButtonRepeat *repeat = &button->priv->repeat [key];
+    gint64 start;
+    
+    XFPM_DEBUG_ENUM (key, XFPM_TYPE_BUTTON_KEY, "Key press x%u", steps);
+    
+    start = g_get_monotonic_time ();
+    
+    if ( steps == 1 )
+	g_signal_emit (G_OBJECT(button), signals[BUTTON_PRESSED], 0, key);
+    else
+	g_signal_emit (G_OBJECT(button), signals[BUTTON_REPEATED], 0, key, steps);
+    
+    repeat->last_dispatch = g_get_monotonic_time ();
+    repeat->cost = repeat->last_dispatch - start;
+}
+
+static gboolean
+blpm_button_repeat_flush (gpointer data)
+{
+    XfpmButtonRepeat *repeat = data;
+    guint steps = repeat->steps;
+    
+    repeat->flush_id = 0;
+    repeat->steps = 0;
+    
+    blpm_button_dispatch (repeat->button, repeat->key, steps);
+    
+    return FALSE;
+}
+
+/*
+ * A press arriving before the handlers could have finished with the
+ * previous one is held back, and all the held presses are sent as a
+ * single step count once the key is due again.
+ */
+static void
+blpm_button_key_pressed (XfpmButton *button, XfpmButtonKey key)
+{
+    XfpmButtonRepeat *repeat;
+    gint64 now, window;
     
-    for ( i = 0; i < G_N_ELEMENTS (blpm_key_map); i++)
+    if ( !XFPM_BUTTON_KEY_REPEATS (key) )
     {
-	if ( blpm_key_map [i].key_code == keycode )
-	    key = blpm_key_map [i].key;
+	blpm_button_dispatch (button, key, 1);
+	return;
     }
     
-    return key;
+    repeat = &button->priv->repeat [key];
+    window = MAX (repeat->cost, XFPM_BUTTON_REPEAT_INTERVAL * 1000);
+    now = g_get_monotonic_time ();
+    
+    if ( repeat->flush_id == 0 && now - repeat->last_dispatch >= window )
+    {
+	blpm_button_dispatch (button, key, 1);
+	return;
+    }
+    
+    repeat->steps++;
+    
+    if ( repeat->flush_id == 0 )
+	repeat->flush_id = g_timeout_add (MAX ((repeat->last_dispatch + window - now) / 1000, 1),
+					  blpm_button_repeat_flush, repeat);
 }
 
 static GdkFilterReturn
 blpm_button_filter_x_events (GdkXEvent *xevent, GdkEvent *ev, gpointer data)
 {
     XfpmButtonKey key;
-    XfpmButton *button;
     
     XEvent *xev = (XEvent *) xevent;
     
     if ( xev->type != KeyPress )
     	return GDK_FILTER_CONTINUE;
     
-    key = blpm_button_get_key (xev->xkey.keycode);
+    key = blpm_keycode_map [xev->xkey.keycode & 0xff];
     
     if ( key != BUTTON_UNKNOWN )
     {
-	button = (XfpmButton *) data;
-    
-	XFPM_DEBUG_ENUM (key, XFPM_TYPE_BUTTON_KEY, "Key press");
-    
-	g_signal_emit (G_OBJECT(button), signals[BUTTON_PRESSED], 0, key);
+	blpm_button_key_pressed ((XfpmButton *) data, key);
 	return GDK_FILTER_REMOVE;
     }
     
@@ -182,8 +251,7 @@ blpm_button_xevent_key (XfpmButton *button, guint keysym , XfpmButtonKey key)
     
     XFPM_DEBUG_ENUM (key, XFPM_TYPE_BUTTON_KEY, "Grabbed key %li ", (long int) keycode);
     
-    blpm_key_map [key].key_code = keycode;
-    blpm_key_map [key].key = key;
+    blpm_keycode_map [keycode & 0xff] = key;
     
     return TRUE;
 }
@@ -242,6 +310,15 @@ blpm_button_class_init(XfpmButtonClass *klass)
                       g_cclosure_marshal_VOID__ENUM,
                       G_TYPE_NONE, 1, XFPM_TYPE_BUTTON_KEY);
 
+    signals [BUTTON_REPEATED] = 
+        g_signal_new ("button-repeated",
+                      XFPM_TYPE_BUTTON,
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (XfpmButtonClass, button_repeated),
+                      NULL, NULL,
+                      _blpm_marshal_VOID__ENUM_UINT,
+                      G_TYPE_NONE, 2, XFPM_TYPE_BUTTON_KEY, G_TYPE_UINT);
+
     object_class->finalize = blpm_button_finalize;
 
     g_type_class_add_private (klass, sizeof (XfpmButtonPrivate));
@@ -250,8 +327,16 @@ blpm_button_class_init(XfpmButtonClass *klass)
 static void
 blpm_button_init (XfpmButton *button)
 {
+    guint i;
+    
     button->priv = XFPM_BUTTON_GET_PRIVATE (button);
     
+    for ( i = 0; i < NUMBER_OF_BUTTONS; i++ )
+    {
+	button->priv->repeat [i].button = button;
+	button->priv->repeat [i].key = i;
+    }
+    
     button->priv->mapped_buttons = 0;
     button->priv->screen = NULL;
     button->priv->window = NULL;
@@ -262,6 +347,20 @@ blpm_button_init (XfpmButton *button)
 static void
 blpm_button_finalize (GObject *object)
 {
+    XfpmButton *button;
+    guint i;
+    
+    button = XFPM_BUTTON (object);
+    
+    gdk_window_remove_filter (button->priv->window, 
+			      blpm_button_filter_x_events, button);
+    
+    for ( i = 0; i < NUMBER_OF_BUTTONS; i++ )
+    {
+	if ( button->priv->repeat [i].flush_id != 0 )
+	    g_source_remove (button->priv->repeat [i].flush_id);
+    }
+    
     G_OBJECT_CLASS(blpm_button_parent_class)->finalize(object);
 }
 
@@ -47,6 +47,10 @@ typedef struct
     void                 	(*button_pressed)		        (XfpmButton *button,
 								         XfpmButtonKey type);
     
+    void                 	(*button_repeated)		        (XfpmButton *button,
+								         XfpmButtonKey type,
+								         guint steps);
+    
 } XfpmButtonClass;
 
 GType                 		blpm_button_get_type               	(void) G_GNUC_CONST;
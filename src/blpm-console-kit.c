@@ -34,6 +34,7 @@
 
 #include "blpm-console-kit.h"
 #include "blpm-dbus-monitor.h"
+#include "blpm-debug.h"
 
 
 static void blpm_console_kit_finalize   (GObject *object);
@@ -46,6 +47,19 @@ static void blpm_console_kit_get_property (GObject *object,
 #define XFPM_CONSOLE_KIT_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_CONSOLE_KIT, XfpmConsoleKitPrivate))
 
+/*
+ * The capability queries, all sent at once. The answers are kept until
+ * ConsoleKit changes owner.
+ */
+typedef enum
+{
+    XFPM_CONSOLE_KIT_QUERY_CAN_STOP,
+    XFPM_CONSOLE_KIT_QUERY_CAN_RESTART,
+    XFPM_CONSOLE_KIT_QUERY_CAN_SUSPEND,
+    XFPM_CONSOLE_KIT_QUERY_CAN_HIBERNATE,
+    XFPM_CONSOLE_KIT_QUERY_N
+} XfpmConsoleKitQuery;
+
 struct XfpmConsoleKitPrivate
 {
     DBusGConnection *bus;
@@ -57,8 +71,38 @@ struct XfpmConsoleKitPrivate
     gboolean	     can_restart;
     gboolean         can_suspend;
     gboolean         can_hibernate;
+
+    DBusGProxyCall  *calls [XFPM_CONSOLE_KIT_QUERY_N];
+};
+
+static const struct
+{
+    const gchar *method;
+    const gchar *property;
+    gboolean     string_reply;	/* ConsoleKit2 answers "yes", "no", "challenge"... */
+    glong        offset;
+} blpm_console_kit_queries [XFPM_CONSOLE_KIT_QUERY_N] =
+{
+    { "CanStop",      "can-shutdown",  FALSE, G_STRUCT_OFFSET (XfpmConsoleKitPrivate, can_shutdown) },
+    { "CanRestart",   "can-restart",   FALSE, G_STRUCT_OFFSET (XfpmConsoleKitPrivate, can_restart) },
+    { "CanSuspend",   "can-suspend",   TRUE,  G_STRUCT_OFFSET (XfpmConsoleKitPrivate, can_suspend) },
+    { "CanHibernate", "can-hibernate", TRUE,  G_STRUCT_OFFSET (XfpmConsoleKitPrivate, can_hibernate) }
+};
+
+typedef struct
+{
+    XfpmConsoleKit     *console;
+    XfpmConsoleKitQuery query;
+} XfpmConsoleKitCall;
+
+enum
+{
+    INFO_READY,
+    LAST_SIGNAL
 };
 
+static guint signals [LAST_SIGNAL] = { 0 };
+
 enum
 {
     PROP_0,
@@ -71,73 +115,133 @@ enum
 G_DEFINE_TYPE (XfpmConsoleKit, blpm_console_kit, G_TYPE_OBJECT)
 
 static void
-blpm_console_kit_get_info (XfpmConsoleKit *console)
+blpm_console_kit_set_capability (XfpmConsoleKit *console, XfpmConsoleKitQuery query, gboolean value)
 {
+    gboolean *field;
+
+    field = G_STRUCT_MEMBER_P (console->priv, blpm_console_kit_queries [query].offset);
+
+    if ( *field == value )
+	return;
+
+    *field = value;
+    g_object_notify (G_OBJECT (console), blpm_console_kit_queries [query].property);
+}
+
+static void
+blpm_console_kit_query_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmConsoleKitCall *ck_call = data;
+    XfpmConsoleKit *console = ck_call->console;
+    XfpmConsoleKitQuery query = ck_call->query;
     GError *error = NULL;
+    gboolean value = FALSE;
     gchar *tmp = NULL;
+    gboolean ret;
 
-    dbus_g_proxy_call (console->priv->proxy, "CanStop", &error,
-		       G_TYPE_INVALID,
-		       G_TYPE_BOOLEAN, &console->priv->can_shutdown,
-		       G_TYPE_INVALID);
-		       
-    if ( error )
+    console->priv->calls [query] = NULL;
+
+    if ( blpm_console_kit_queries [query].string_reply )
     {
-	g_warning ("'CanStop' method failed : %s", error->message);
-	g_clear_error (&error);
+	ret = dbus_g_proxy_end_call (proxy, call, &error,
+				     G_TYPE_STRING, &tmp,
+				     G_TYPE_INVALID);
+	if ( ret )
+	    value = g_strcmp0 (tmp, "yes") == 0 || g_strcmp0 (tmp, "challenge") == 0;
+	g_free (tmp);
     }
-    
-    dbus_g_proxy_call (console->priv->proxy, "CanRestart", &error,
-		       G_TYPE_INVALID,
-		       G_TYPE_BOOLEAN, &console->priv->can_restart,
-		       G_TYPE_INVALID);
-		       
-    if ( error )
+    else
     {
-	g_warning ("'CanRestart' method failed : %s", error->message);
-	g_clear_error (&error);
+	ret = dbus_g_proxy_end_call (proxy, call, &error,
+				     G_TYPE_BOOLEAN, &value,
+				     G_TYPE_INVALID);
     }
 
-    /* start with FALSE */
-    console->priv->can_suspend = FALSE;
-
-    dbus_g_proxy_call (console->priv->proxy, "CanSuspend", &error,
-		       G_TYPE_INVALID,
-		       G_TYPE_STRING, &tmp,
-		       G_TYPE_INVALID);
-
-    if ( error )
+    if ( !ret )
     {
-	g_debug ("'CanSuspend' method failed : %s", error->message);
-	g_clear_error (&error);
+	/* CanSuspend and CanHibernate only exist on ConsoleKit2 */
+	if ( blpm_console_kit_queries [query].string_reply )
+	    g_debug ("'%s' method failed : %s", blpm_console_kit_queries [query].method, error->message);
+	else
+	    g_warning ("'%s' method failed : %s", blpm_console_kit_queries [query].method, error->message);
+	g_error_free (error);
+	value = FALSE;
     }
-    else
+
+    blpm_console_kit_set_capability (console, query, value);
+
+    /* the last answer in */
+    if ( !blpm_console_kit_info_pending (console) )
+	g_signal_emit (G_OBJECT (console), signals [INFO_READY], 0);
+}
+
+static void
+blpm_console_kit_cancel_info (XfpmConsoleKit *console)
+{
+    gint i;
+
+    for ( i = 0; i < XFPM_CONSOLE_KIT_QUERY_N; i++ )
     {
-	if (g_strcmp0 (tmp, "yes") == 0 || g_strcmp0 (tmp, "challenge") == 0)
+	if ( console->priv->calls [i] != NULL )
 	{
-	    console->priv->can_suspend = TRUE;
+	    dbus_g_proxy_cancel_call (console->priv->proxy, console->priv->calls [i]);
+	    console->priv->calls [i] = NULL;
 	}
     }
+}
 
-    /* start with FALSE */
-    console->priv->can_hibernate = FALSE;
+/*
+ * Sends all capability queries in parallel, the properties are
+ * notified as the answers come in and "info-ready" once all of them
+ * are known.
+ */
+static void
+blpm_console_kit_get_info (XfpmConsoleKit *console)
+{
+    XfpmConsoleKitCall *ck_call;
+    gint i;
 
-    dbus_g_proxy_call (console->priv->proxy, "CanHibernate", &error,
-		       G_TYPE_INVALID,
-		       G_TYPE_STRING, &tmp,
-		       G_TYPE_INVALID);
+    blpm_console_kit_cancel_info (console);
 
-    if ( error )
+    for ( i = 0; i < XFPM_CONSOLE_KIT_QUERY_N; i++ )
+    {
+	ck_call = g_new0 (XfpmConsoleKitCall, 1);
+	ck_call->console = console;
+	ck_call->query = i;
+
+	blpm_startup_count_dbus_call ();
+	console->priv->calls [i] = dbus_g_proxy_begin_call (console->priv->proxy,
+							    blpm_console_kit_queries [i].method,
+							    blpm_console_kit_query_reply,
+							    ck_call, g_free,
+							    G_TYPE_INVALID);
+    }
+}
+
+static void
+blpm_console_kit_service_connection_changed_cb (XfpmDBusMonitor *monitor,
+						gchar *service_name,
+						gboolean connected,
+						gboolean on_session,
+						XfpmConsoleKit *console)
+{
+    gint i;
+
+    if ( on_session || g_strcmp0 (service_name, "org.freedesktop.ConsoleKit") != 0 )
+	return;
+
+    XFPM_DEBUG ("ConsoleKit %s, dropping cached capabilities", connected ? "appeared" : "went away");
+
+    if ( connected )
     {
-	g_debug ("'CanHibernate' method failed : %s", error->message);
-	g_clear_error (&error);
+	blpm_console_kit_get_info (console);
     }
     else
     {
-	if (g_strcmp0 (tmp, "yes") == 0 || g_strcmp0 (tmp, "challenge") == 0)
-	{
-	    console->priv->can_hibernate = TRUE;
-	}
+	blpm_console_kit_cancel_info (console);
+	for ( i = 0; i < XFPM_CONSOLE_KIT_QUERY_N; i++ )
+	    blpm_console_kit_set_capability (console, i, FALSE);
+	g_signal_emit (G_OBJECT (console), signals [INFO_READY], 0);
     }
 }
 
@@ -150,6 +254,15 @@ blpm_console_kit_class_init (XfpmConsoleKitClass *klass)
 
     object_class->get_property = blpm_console_kit_get_property;
     
+    signals [INFO_READY] =
+    	g_signal_new ("info-ready",
+		      XFPM_TYPE_CONSOLE_KIT,
+		      G_SIGNAL_RUN_LAST,
+		      G_STRUCT_OFFSET (XfpmConsoleKitClass, info_ready),
+		      NULL, NULL,
+		      g_cclosure_marshal_VOID__VOID,
+		      G_TYPE_NONE, 0);
+    
     g_object_class_install_property (object_class,
                                      PROP_CAN_RESTART,
                                      g_param_spec_boolean ("can-restart",
@@ -202,17 +315,22 @@ blpm_console_kit_init (XfpmConsoleKit *console)
 	return;
     }
     
-    console->priv->proxy = dbus_g_proxy_new_for_name_owner (console->priv->bus,
-							    "org.freedesktop.ConsoleKit",
-							    "/org/freedesktop/ConsoleKit/Manager",
-							    "org.freedesktop.ConsoleKit.Manager",
-							    NULL);
+    /* follows the name, so the proxy outlives a ConsoleKit restart */
+    console->priv->proxy = dbus_g_proxy_new_for_name (console->priv->bus,
+						      "org.freedesktop.ConsoleKit",
+						      "/org/freedesktop/ConsoleKit/Manager",
+						      "org.freedesktop.ConsoleKit.Manager");
 						      
     if ( !console->priv->proxy )
     {
 	g_warning ("Unable to create proxy for 'org.freedesktop.ConsoleKit'");
 	return;
     }
+
+    console->priv->monitor = blpm_dbus_monitor_new ();
+    blpm_dbus_monitor_add_service (console->priv->monitor, DBUS_BUS_SYSTEM, "org.freedesktop.ConsoleKit");
+    g_signal_connect (console->priv->monitor, "service-connection-changed",
+		      G_CALLBACK (blpm_console_kit_service_connection_changed_cb), console);
     
     blpm_console_kit_get_info (console);
 }
@@ -251,12 +369,22 @@ blpm_console_kit_finalize (GObject *object)
     XfpmConsoleKit *console;
 
     console = XFPM_CONSOLE_KIT (object);
-    
-    if ( console->priv->bus )
-	dbus_g_connection_unref (console->priv->bus);
-	
+
+    if ( console->priv->monitor )
+    {
+	g_signal_handlers_disconnect_by_data (console->priv->monitor, console);
+	blpm_dbus_monitor_remove_service (console->priv->monitor, DBUS_BUS_SYSTEM, "org.freedesktop.ConsoleKit");
+	g_object_unref (console->priv->monitor);
+    }
+
     if ( console->priv->proxy )
+    {
+	blpm_console_kit_cancel_info (console);
 	g_object_unref (console->priv->proxy);
+    }
+
+    if ( console->priv->bus )
+	dbus_g_connection_unref (console->priv->bus);
 
     G_OBJECT_CLASS (blpm_console_kit_parent_class)->finalize (object);
 }
@@ -279,6 +407,25 @@ blpm_console_kit_new (void)
     return XFPM_CONSOLE_KIT (console_obj);
 }
 
+/*
+ * TRUE while capability queries are in flight, the properties are not
+ * to be trusted until "info-ready".
+ */
+gboolean blpm_console_kit_info_pending (XfpmConsoleKit *console)
+{
+    gint i;
+
+    g_return_val_if_fail (XFPM_IS_CONSOLE_KIT (console), FALSE);
+
+    for ( i = 0; i < XFPM_CONSOLE_KIT_QUERY_N; i++ )
+    {
+	if ( console->priv->calls [i] != NULL )
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
 void blpm_console_kit_shutdown (XfpmConsoleKit *console, GError **error)
 {
     g_return_if_fail (console->priv->proxy != NULL );
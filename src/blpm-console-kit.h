@@ -42,12 +42,16 @@ typedef struct
 {
     GObjectClass 		parent_class;
     
+    void                        (*info_ready)			 (XfpmConsoleKit *console);
+    
 } XfpmConsoleKitClass;
 
 GType        			blpm_console_kit_get_type        (void) G_GNUC_CONST;
 
 XfpmConsoleKit       	       *blpm_console_kit_new             (void);
 
+gboolean			blpm_console_kit_info_pending	 (XfpmConsoleKit *console);
+
 void				blpm_console_kit_shutdown	 (XfpmConsoleKit *console,
 								  GError **error);
 
@@ -59,6 +59,7 @@ struct XfpmDpmsPrivate
     
     gulong	     switch_off_timeout_id;
     gulong	     switch_on_timeout_id;
+    guint	     refresh_id;
 };
 
 G_DEFINE_TYPE (XfpmDpms, blpm_dpms, G_TYPE_OBJECT)
@@ -114,37 +115,31 @@ blpm_dpms_enable (XfpmDpms *dpms)
 static void
 blpm_dpms_get_enabled (XfpmDpms *dpms, gboolean *dpms_enabled)
 {
-    g_object_get (G_OBJECT (dpms->priv->conf),
-		  DPMS_ENABLED_CFG, dpms_enabled,
-		  NULL);
+    *dpms_enabled = blpm_blconf_get_settings (dpms->priv->conf)->dpms_enabled;
 }
 
 static void
 blpm_dpms_get_sleep_mode (XfpmDpms *dpms, gboolean *ret_standby_mode)
 {
-    gchar *sleep_mode;
+    const gchar *sleep_mode;
     
-    g_object_get (G_OBJECT (dpms->priv->conf),
-		  DPMS_SLEEP_MODE, &sleep_mode,
-		  NULL);
+    sleep_mode = blpm_blconf_get_settings (dpms->priv->conf)->dpms_sleep_mode;
     
     if ( !g_strcmp0 (sleep_mode, "Standby"))
 	*ret_standby_mode = TRUE;
     else
 	*ret_standby_mode = FALSE;
-	
-    g_free (sleep_mode);
 }
 
 static void
 blpm_dpms_get_configuration_timeouts (XfpmDpms *dpms, guint16 *ret_sleep, guint16 *ret_off )
 {
+    const XfpmBlconfSettings *settings;
     guint sleep_time, off_time;
     
-    g_object_get (G_OBJECT (dpms->priv->conf),
-		  dpms->priv->on_battery ? ON_BATT_DPMS_SLEEP : ON_AC_DPMS_SLEEP, &sleep_time,
-		  dpms->priv->on_battery ? ON_BATT_DPMS_OFF : ON_AC_DPMS_OFF, &off_time,
-		  NULL);
+    settings = blpm_blconf_get_settings (dpms->priv->conf);
+    sleep_time = dpms->priv->on_battery ? settings->dpms_on_battery_sleep : settings->dpms_on_ac_sleep;
+    off_time   = dpms->priv->on_battery ? settings->dpms_on_battery_off : settings->dpms_on_ac_off;
 		  
     *ret_sleep = sleep_time * 60;
     *ret_off =  off_time * 60;
@@ -192,13 +187,25 @@ blpm_dpms_refresh (XfpmDpms *dpms)
     }
 }
 
+static gboolean
+blpm_dpms_refresh_idle (gpointer data)
+{
+    XfpmDpms *dpms = data;
+
+    dpms->priv->refresh_id = 0;
+    blpm_dpms_refresh (dpms);
+
+    return FALSE;
+}
+
 static void
 blpm_dpms_settings_changed_cb (GObject *obj, GParamSpec *spec, XfpmDpms *dpms)
 {
-    if ( g_str_has_prefix (spec->name, "dpms"))
+    /* several dpms keys usually change together, refresh once for all */
+    if ( g_str_has_prefix (spec->name, "dpms") && dpms->priv->refresh_id == 0 )
     {
 	XFPM_DEBUG ("Configuration changed");
-	blpm_dpms_refresh (dpms);
+	dpms->priv->refresh_id = g_idle_add (blpm_dpms_refresh_idle, dpms);
     }
 }
 
@@ -223,6 +230,7 @@ blpm_dpms_init(XfpmDpms *dpms)
     dpms->priv->dpms_capable = DPMSCapable (gdk_x11_get_default_xdisplay());
     dpms->priv->switch_off_timeout_id = 0;
     dpms->priv->switch_on_timeout_id = 0;
+    dpms->priv->refresh_id = 0;
 
     if ( dpms->priv->dpms_capable )
     {
@@ -245,6 +253,9 @@ blpm_dpms_finalize(GObject *object)
     XfpmDpms *dpms;
 
     dpms = XFPM_DPMS (object);
+
+    if ( dpms->priv->refresh_id != 0 )
+	g_source_remove (dpms->priv->refresh_id);
     
     g_object_unref (dpms->priv->conf);
 
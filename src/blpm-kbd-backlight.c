@@ -33,6 +33,7 @@
 #include "blpm-button.h"
 #include "blpm-notify.h"
 #include "blpm-power.h"
+#include "blpm-debug.h"
 
 #define XFPM_KBD_BACKLIGHT_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_KBD_BACKLIGHT, XfpmKbdBacklightPrivate))
@@ -54,7 +55,6 @@ struct XfpmKbdBacklightPrivate
     gint             step;
 
     XfpmNotify      *notify;
-    NotifyNotification *n;
 };
 
 G_DEFINE_TYPE (XfpmKbdBacklight, blpm_kbd_backlight, G_TYPE_OBJECT)
@@ -100,27 +100,12 @@ blpm_kbd_backlight_show_notification (XfpmKbdBacklight *self, gfloat value)
 {
     gchar *summary;
 
-    if ( self->priv->n == NULL )
-    {
-        self->priv->n = blpm_notify_new_notification (self->priv->notify,
-                "",
-                "",
-                "blpm-brightness-keyboard",
-                0,
-                XFPM_NOTIFY_NORMAL,
-                NULL);
-    }
-
     /* generate a human-readable summary for the notification */
     summary = g_strdup_printf (_("Keyboard Brightness: %.0f percent"), value);
-    notify_notification_update (self->priv->n, summary, NULL, NULL);
-    g_free (summary);
-
-    /* add the brightness value to the notification */
-    notify_notification_set_hint_int32 (self->priv->n, "value", value);
 
-    /* show the notification */
-    notify_notification_show (self->priv->n, NULL);
+    blpm_notify_show_value (self->priv->notify, XFPM_NOTIFY_CATEGORY_KBD_BRIGHTNESS,
+                            summary, "blpm-brightness-keyboard", value);
+    g_free (summary);
 }
 
 
@@ -164,60 +149,50 @@ blpm_kbd_backlight_set_level (XfpmKbdBacklight *backlight, gint level)
     }
 }
 
+/* negative steps go down */
 static void
-blpm_kbd_backlight_up (XfpmKbdBacklight *backlight)
+blpm_kbd_backlight_step (XfpmKbdBacklight *backlight, gint steps)
 {
-    gint level;
+    gint level, new_level;
 
     level = blpm_kbd_backlight_get_level(backlight);
 
     if ( level == -1)
         return;
 
-    if ( level == backlight->priv->max_level )
-        return;
-
-    level += backlight->priv->step;
+    new_level = CLAMP (level + steps * backlight->priv->step,
+                       backlight->priv->min_level, backlight->priv->max_level);
 
-    if ( level > backlight->priv->max_level )
-        level = backlight->priv->max_level;
+    if ( new_level == level )
+        return;
 
-    blpm_kbd_backlight_set_level(backlight, level);
+    blpm_kbd_backlight_set_level(backlight, new_level);
 }
 
 
 static void
-blpm_kbd_backlight_down (XfpmKbdBacklight *backlight)
+blpm_kbd_backlight_button_pressed_cb (XfpmButton *button, XfpmButtonKey type, XfpmKbdBacklight *backlight)
 {
-    gint level;
-
-    level = blpm_kbd_backlight_get_level(backlight);
-
-    if ( level == -1)
-        return;
-
-    if ( level == backlight->priv->min_level )
-        return;
-
-    level -= backlight->priv->step;
-
-    if ( level < backlight->priv->min_level )
-        level = backlight->priv->min_level;
-
-    blpm_kbd_backlight_set_level(backlight, level);
+    if ( type == BUTTON_KBD_BRIGHTNESS_UP )
+    {
+        blpm_kbd_backlight_step (backlight, 1);
+    }
+    else if ( type == BUTTON_KBD_BRIGHTNESS_DOWN )
+    {
+        blpm_kbd_backlight_step (backlight, -1);
+    }
 }
 
-
 static void
-blpm_kbd_backlight_button_pressed_cb (XfpmButton *button, XfpmButtonKey type, XfpmKbdBacklight *backlight)
+blpm_kbd_backlight_button_repeated_cb (XfpmButton *button, XfpmButtonKey type, guint steps, XfpmKbdBacklight *backlight)
 {
     if ( type == BUTTON_KBD_BRIGHTNESS_UP )
     {
-        blpm_kbd_backlight_up (backlight);
+        blpm_kbd_backlight_step (backlight, steps);
     }
     else if ( type == BUTTON_KBD_BRIGHTNESS_DOWN )
     {
-        blpm_kbd_backlight_down (backlight);
+        blpm_kbd_backlight_step (backlight, -(gint) steps);
     }
 }
 
@@ -249,7 +224,6 @@ blpm_kbd_backlight_init (XfpmKbdBacklight *backlight)
     backlight->priv->max_level = 0;
     backlight->priv->min_level = 0;
     backlight->priv->notify = NULL;
-    backlight->priv->n = NULL;
 
     backlight->priv->bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
 
@@ -282,6 +256,8 @@ blpm_kbd_backlight_init (XfpmKbdBacklight *backlight)
 
     g_signal_connect (backlight->priv->button, "button-pressed",
                       G_CALLBACK (blpm_kbd_backlight_button_pressed_cb), backlight);
+    g_signal_connect (backlight->priv->button, "button-repeated",
+                      G_CALLBACK (blpm_kbd_backlight_button_repeated_cb), backlight);
 
     g_signal_connect (backlight->priv->power, "on-battery-changed",
                       G_CALLBACK (blpm_kbd_backlight_on_battery_changed_cb), backlight);
@@ -311,9 +287,6 @@ blpm_kbd_backlight_finalize (GObject *object)
     if ( backlight->priv->notify )
         g_object_unref (backlight->priv->notify);
 
-    if ( backlight->priv->n )
-        g_object_unref (backlight->priv->n);
-
     if ( backlight->priv->proxy )
         g_object_unref (backlight->priv->proxy);
 
@@ -337,3 +310,26 @@ gboolean blpm_kbd_backlight_has_hw (XfpmKbdBacklight *backlight)
 {
     return ( backlight->priv->proxy == NULL ) ? FALSE : TRUE;
 }
+
+gint blpm_kbd_backlight_get_brightness (XfpmKbdBacklight *backlight)
+{
+    if ( !blpm_kbd_backlight_has_hw (backlight) )
+        return -1;
+
+    return blpm_kbd_backlight_get_level (backlight);
+}
+
+/*
+ * Like set_level, without the notification, for putting back a level
+ * saved earlier.
+ */
+void blpm_kbd_backlight_restore_brightness (XfpmKbdBacklight *backlight, gint level)
+{
+    if ( !blpm_kbd_backlight_has_hw (backlight) || level < 0 )
+        return;
+
+    /* a plain fire and forget, nothing to report back to the user */
+    dbus_g_proxy_call_no_reply (backlight->priv->proxy, "SetBrightness",
+                                G_TYPE_INT, level,
+                                G_TYPE_INVALID);
+}
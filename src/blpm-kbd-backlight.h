@@ -50,6 +50,11 @@ XfpmKbdBacklight               *blpm_kbd_backlight_new              (void);
 
 gboolean                        blpm_kbd_backlight_has_hw           (XfpmKbdBacklight *backlight);
 
+gint                            blpm_kbd_backlight_get_brightness   (XfpmKbdBacklight *backlight);
+
+void                            blpm_kbd_backlight_restore_brightness (XfpmKbdBacklight *backlight,
+                                                                     gint level);
+
 G_END_DECLS
 
 #endif /* __XFPM_KBD_BACKLIGHT_H */
@@ -74,6 +74,16 @@ blpm_quit_signal (gint sig, gpointer data)
 	blpm_manager_stop (manager);
 }
 
+static void
+blpm_dump_trace_signal (gint sig, gpointer data)
+{
+    gchar *trace;
+
+    trace = blpm_trace_to_string ();
+    g_printerr ("%s", trace);
+    g_free (trace);
+}
+
 static const gchar *
 blpm_bool_to_local_string (gboolean value)
 {
@@ -153,6 +163,55 @@ blpm_dump (GHashTable *hash)
 	      blpm_bool_to_local_string (has_sleep_button),
 	     _("Has LID"),
 	      blpm_bool_to_local_string (has_lid));
+
+    g_print ("---------------------------------------------------\n");
+    g_print (_("Idle periods, log2 seconds buckets\n"));
+    g_print ( "%s: %s\n"
+	      "%s: %s\n",
+	     _("On AC"),
+	     (gchar *) g_hash_table_lookup (hash, "idle-histogram-on-ac"),
+	     _("On battery"),
+	     (gchar *) g_hash_table_lookup (hash, "idle-histogram-on-battery"));
+
+    if ( g_hash_table_lookup (hash, "resume-latency") != NULL &&
+	 g_ascii_strtod (g_hash_table_lookup (hash, "resume-latency"), NULL) >= 0 )
+    {
+	g_print ("---------------------------------------------------\n");
+	g_print ("%s: %s ms\n",
+		 _("Last resume latency"),
+		 (gchar *) g_hash_table_lookup (hash, "resume-latency"));
+    }
+
+    if ( g_hash_table_lookup (hash, "sleep-timings") != NULL )
+    {
+	g_print ("---------------------------------------------------\n");
+	g_print (_("Sleep timings, ms since the sleeping signal\n"));
+	g_print ("%s", (gchar *) g_hash_table_lookup (hash, "sleep-timings"));
+    }
+
+    if ( g_hash_table_lookup (hash, "startup-trace") != NULL )
+    {
+	g_print ("---------------------------------------------------\n");
+	g_print (_("Startup trace\n"));
+	g_print ("%s", (gchar *) g_hash_table_lookup (hash, "startup-trace"));
+    }
+}
+
+static void
+blpm_write_startup_trace (const gchar *filename)
+{
+    GError *error = NULL;
+    gchar *trace;
+
+    trace = blpm_startup_trace_to_string ();
+
+    if ( !g_file_set_contents (filename, trace, -1, &error) )
+    {
+	g_warning ("Unable to write startup trace to %s: %s", filename, error->message);
+	g_error_free (error);
+    }
+
+    g_free (trace);
 }
 
 static void
@@ -184,14 +243,17 @@ blpm_dump_remote (DBusGConnection *bus)
 }
 
 static void G_GNUC_NORETURN
-blpm_start (DBusGConnection *bus, const gchar *client_id, gboolean dump)
+blpm_start (DBusGConnection *bus, const gchar *client_id, gboolean dump,
+	    const gchar *startup_trace)
 {
     XfpmManager *manager;
     GError *error = NULL;
     
     XFPM_DEBUG ("Starting the power manager");
     
+    blpm_startup_phase_begin ("manager-new");
     manager = blpm_manager_new (bus, client_id);
+    blpm_startup_phase_end ("manager-new");
 
     if ( xfce_posix_signal_handler_init (&error)) 
     {
@@ -206,6 +268,10 @@ blpm_start (DBusGConnection *bus, const gchar *client_id, gboolean dump)
         xfce_posix_signal_handler_set_handler (SIGTERM,
                                                blpm_quit_signal,
                                                manager, NULL);
+
+        xfce_posix_signal_handler_set_handler (SIGUSR1,
+                                               blpm_dump_trace_signal,
+                                               NULL, NULL);
     } 
     else 
     {
@@ -214,6 +280,12 @@ blpm_start (DBusGConnection *bus, const gchar *client_id, gboolean dump)
     }
 
     blpm_manager_start (manager);
+
+    blpm_startup_phase_end ("startup");
+    blpm_startup_trace_finish ();
+
+    if ( startup_trace != NULL )
+	blpm_write_startup_trace (startup_trace);
     
     if ( dump )
     {
@@ -245,15 +317,19 @@ int main (int argc, char **argv)
     gboolean reload     = FALSE;
     gboolean no_daemon  = FALSE;
     gboolean debug      = FALSE;
+    gboolean trace      = FALSE;
     gboolean dump       = FALSE;
     gchar   *client_id  = NULL;
+    gchar   *startup_trace = NULL;
     
     GOptionEntry option_entries[] = 
     {
 	{ "run",'r', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &run, NULL, NULL },
 	{ "no-daemon",'\0' , G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &no_daemon, N_("Do not daemonize"), NULL },
 	{ "debug",'\0' , G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &debug, N_("Enable debugging"), NULL },
+	{ "trace",'\0' , G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &trace, N_("Keep recent debug messages for SIGUSR1 and GetTrace"), NULL },
 	{ "dump",'\0' , G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &dump, N_("Dump all information"), NULL },
+	{ "startup-trace",'\0' , G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_FILENAME, &startup_trace, N_("Write a startup timeline to FILE"), N_("FILE") },
 	{ "restart", '\0', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &reload, N_("Restart the running instance of Xfce power manager"), NULL},
 	{ "customize", 'c', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &config, N_("Show the configuration dialog"), NULL },
 	{ "quit", 'q', G_OPTION_FLAG_IN_MAIN, G_OPTION_ARG_NONE, &quit, N_("Quit any running xfce power manager"), NULL },
@@ -296,6 +372,8 @@ int main (int argc, char **argv)
         g_critical ("Could not daemonize");
     }
 
+    blpm_startup_phase_begin ("startup");
+
     /* Initialize */
     dbus_g_thread_init ();
 
@@ -303,6 +381,8 @@ int main (int argc, char **argv)
 
     g_set_application_name (PACKAGE_NAME);
 
+    blpm_startup_phase_begin ("gtk-init");
+
     if (!gtk_init_check (&argc, &argv))
     {
         if (G_LIKELY (error))
@@ -320,9 +400,14 @@ int main (int argc, char **argv)
         return EXIT_FAILURE;
     }
     
-    blpm_debug_init (debug);
+    blpm_startup_phase_end ("gtk-init");
+
+    blpm_debug_init (debug, trace);
     
+    blpm_startup_phase_begin ("session-bus");
+    blpm_startup_count_dbus_call ();
     bus = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
+    blpm_startup_phase_end ("session-bus");
             
     if ( error )
     {
@@ -385,7 +470,7 @@ int main (int argc, char **argv)
 	    !blpm_dbus_name_has_owner (dbus_g_connection_get_connection (bus), "org.freedesktop.PowerManagement"))
 	{
 	    g_print ("Xfce power manager is not running\n");
-	    blpm_start (bus, client_id, dump);
+	    blpm_start (bus, client_id, dump, startup_trace);
 	}
 	
 	proxy = dbus_g_proxy_new_for_name (bus, 
@@ -419,6 +504,7 @@ int main (int argc, char **argv)
 	}
     }
     
+    blpm_startup_count_dbus_call ();
     if (blpm_dbus_name_has_owner (dbus_g_connection_get_connection (bus), "org.freedesktop.PowerManagement") )
     {
 	g_print ("%s: %s\n", 
@@ -435,7 +521,7 @@ int main (int argc, char **argv)
     }
     else
     {	
-	blpm_start (bus, client_id, dump);
+	blpm_start (bus, client_id, dump, startup_trace);
     }
     
     return EXIT_SUCCESS;
@@ -50,7 +50,9 @@
 #include "blpm-button.h"
 #include "blpm-backlight.h"
 #include "blpm-kbd-backlight.h"
+#include "blpm-resume-state.h"
 #include "blpm-inhibit.h"
+#include "blpm-screen-locker.h"
 #include "egg-idletime.h"
 #include "blpm-config.h"
 #include "blpm-debug.h"
@@ -79,14 +81,55 @@ static void blpm_manager_dbus_init	 (XfpmManager *manager);
 
 static gboolean blpm_manager_quit (XfpmManager *manager);
 
+static void blpm_manager_inhibit_sleep_systemd_cancel (XfpmManager *manager);
+
 static void blpm_manager_show_tray_icon (XfpmManager *manager);
 static void blpm_manager_hide_tray_icon (XfpmManager *manager);
 
+static void blpm_manager_init_backlight	    (XfpmManager *manager);
+static void blpm_manager_init_tray	    (XfpmManager *manager);
+static void blpm_manager_init_kbd_backlight (XfpmManager *manager);
+
 #define XFPM_MANAGER_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE((o), XFPM_TYPE_MANAGER, XfpmManagerPrivate))
 
 #define SLEEP_KEY_TIMEOUT 6.0f
 
+/*
+ * Subsystems that are not needed to own the bus names or to act on a
+ * critical battery. They are brought up one per idle slice once the
+ * main loop runs, or right away when something needs them earlier.
+ */
+typedef enum
+{
+    XFPM_MANAGER_STAGE_BACKLIGHT,
+    XFPM_MANAGER_STAGE_TRAY,
+    XFPM_MANAGER_STAGE_KBD_BACKLIGHT,
+    XFPM_MANAGER_N_STAGES
+
+} XfpmManagerStage;
+
+#define XFPM_MANAGER_STAGE_BIT(stage) (1 << (stage))
+
+typedef struct
+{
+    const gchar *name;
+    guint        depends;	/* stages that have to be up first */
+    void       (*init)		(XfpmManager *manager);
+
+} XfpmManagerStageInfo;
+
+static const XfpmManagerStageInfo blpm_manager_stages [XFPM_MANAGER_N_STAGES] =
+{
+    { "backlight",     0,
+      blpm_manager_init_backlight },
+    /* the brightness slider should start from what the backlight restored */
+    { "tray",          XFPM_MANAGER_STAGE_BIT (XFPM_MANAGER_STAGE_BACKLIGHT),
+      blpm_manager_init_tray },
+    { "kbd-backlight", 0,
+      blpm_manager_init_kbd_backlight }
+};
+
 struct XfpmManagerPrivate
 {
     DBusGConnection    *session_bus;
@@ -103,6 +146,9 @@ struct XfpmManagerPrivate
     XfpmSystemd        *systemd;
     XfpmDBusMonitor    *monitor;
     XfpmInhibit        *inhibit;
+    XfpmScreenLocker   *screen_locker;
+    /* the lid asked for a lock, errors are ours to report */
+    gboolean            lid_lock_pending;
     EggIdletime        *idle;
     GtkStatusIcon      *adapter_icon;
     GtkWidget          *power_button;
@@ -116,6 +162,11 @@ struct XfpmManagerPrivate
     gboolean	        session_managed;
 
     gint                inhibit_fd;
+    /* Inhibit() call in flight, its fd replaces inhibit_fd on success */
+    DBusPendingCall    *inhibit_pending;
+
+    guint               stages_done;
+    guint               stages_id;
 };
 
 enum
@@ -124,6 +175,14 @@ enum
     PROP_SHOW_TRAY_ICON
 };
 
+enum
+{
+    STATE_CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
 G_DEFINE_TYPE (XfpmManager, blpm_manager, G_TYPE_OBJECT)
 
 static void
@@ -137,6 +196,17 @@ blpm_manager_class_init (XfpmManagerClass *klass)
 
     g_type_class_add_private (klass, sizeof (XfpmManagerPrivate));
 
+    /* forwarded from XfpmPower as org.blade.Power.Manager.StateChanged */
+    signals [STATE_CHANGED] =
+        g_signal_new ("state-changed",
+                      XFPM_TYPE_MANAGER,
+                      G_SIGNAL_RUN_LAST,
+                      0,
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__BOXED,
+                      G_TYPE_NONE, 1,
+                      dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE));
+
 #define XFPM_PARAM_FLAGS  (G_PARAM_READWRITE \
                            | G_PARAM_CONSTRUCT \
                            | G_PARAM_STATIC_NAME \
@@ -158,6 +228,7 @@ blpm_manager_init (XfpmManager *manager)
     manager->priv = XFPM_MANAGER_GET_PRIVATE (manager);
 
     manager->priv->timer = g_timer_new ();
+    manager->priv->inhibit_fd = -1;
 
     notify_init ("blade-pm");
 }
@@ -169,6 +240,8 @@ blpm_manager_finalize (GObject *object)
 
     manager = XFPM_MANAGER(object);
 
+    blpm_manager_inhibit_sleep_systemd_cancel (manager);
+
     if ( manager->priv->session_bus )
 	dbus_g_connection_unref (manager->priv->session_bus);
 
@@ -185,15 +258,22 @@ blpm_manager_finalize (GObject *object)
         g_object_unref (manager->priv->console);
     g_object_unref (manager->priv->monitor);
     g_object_unref (manager->priv->inhibit);
+    g_signal_handlers_disconnect_by_data (manager->priv->screen_locker, manager);
+    g_object_unref (manager->priv->screen_locker);
     g_object_unref (manager->priv->idle);
 
     g_timer_destroy (manager->priv->timer);
 
+    if ( manager->priv->stages_id != 0 )
+	g_source_remove (manager->priv->stages_id);
+
     g_object_unref (manager->priv->dpms);
 
-    g_object_unref (manager->priv->backlight);
+    if ( manager->priv->backlight != NULL )
+	g_object_unref (manager->priv->backlight);
 
-    g_object_unref (manager->priv->kbd_backlight);
+    if ( manager->priv->kbd_backlight != NULL )
+	g_object_unref (manager->priv->kbd_backlight);
 
     G_OBJECT_CLASS (blpm_manager_parent_class)->finalize (object);
 }
@@ -213,6 +293,11 @@ blpm_manager_set_property(GObject *object,
             if (new_value != manager->priv->show_tray_icon)
             {
                 manager->priv->show_tray_icon = new_value;
+
+                /* the tray stage picks the value up once it runs */
+                if ( !(manager->priv->stages_done & XFPM_MANAGER_STAGE_BIT (XFPM_MANAGER_STAGE_TRAY)) )
+                    break;
+
                 if (new_value > 0)
                 {
                     blpm_manager_show_tray_icon (manager);
@@ -266,8 +351,10 @@ blpm_manager_quit (XfpmManager *manager)
 
     blpm_manager_release_names (manager);
 
+    blpm_manager_inhibit_sleep_systemd_cancel (manager);
     if (manager->priv->inhibit_fd >= 0)
         close (manager->priv->inhibit_fd);
+    manager->priv->inhibit_fd = -1;
 
     gtk_main_quit ();
     return TRUE;
@@ -284,13 +371,18 @@ blpm_manager_system_bus_connection_changed_cb (XfpmDBusMonitor *monitor, gboolea
     }
 }
 
+static gboolean
+blpm_manager_reserve_name (XfpmManager *manager, const gchar *name)
+{
+    blpm_startup_count_dbus_call ();
+    return blpm_dbus_register_name (dbus_g_connection_get_connection (manager->priv->session_bus), name);
+}
+
 static gboolean
 blpm_manager_reserve_names (XfpmManager *manager)
 {
-    if ( !blpm_dbus_register_name (dbus_g_connection_get_connection (manager->priv->session_bus),
-				   "org.blade.PowerManager") ||
-	 !blpm_dbus_register_name (dbus_g_connection_get_connection (manager->priv->session_bus),
-				  "org.freedesktop.PowerManagement") )
+    if ( !blpm_manager_reserve_name (manager, "org.blade.PowerManager") ||
+	 !blpm_manager_reserve_name (manager, "org.freedesktop.PowerManagement") )
     {
 	g_warning ("Unable to reserve bus name: Maybe any already running instance?\n");
 
@@ -410,6 +502,30 @@ blpm_manager_button_pressed_cb (XfpmButton *bt, XfpmButtonKey type, XfpmManager
     }
 }
 
+static void
+blpm_manager_lock_finished_cb (XfpmScreenLocker *locker, gboolean locked,
+			       gboolean timed_out, XfpmManager *manager)
+{
+    if ( !manager->priv->lid_lock_pending )
+	return;
+
+    manager->priv->lid_lock_pending = FALSE;
+
+    if ( timed_out )
+    {
+	xfce_dialog_show_error (NULL, NULL,
+				_("The screen locker did not answer in time, "
+				  "the screen may not be locked."));
+    }
+    else if ( !locked )
+    {
+	xfce_dialog_show_error (NULL, NULL,
+				_("None of the screen lock tools ran "
+				  "successfully, the screen will not "
+				  "be locked."));
+    }
+}
+
 static void
 blpm_manager_lid_changed_cb (XfpmPower *power, gboolean lid_is_closed, XfpmManager *manager)
 {
@@ -447,13 +563,8 @@ blpm_manager_lid_changed_cb (XfpmPower *power, gboolean lid_is_closed, XfpmManag
 	{
 	    if ( !blpm_is_multihead_connected () )
 	    {
-		if (!blpm_lock_screen ())
-		{
-		    xfce_dialog_show_error (NULL, NULL,
-					    _("None of the screen lock tools ran "
-					      "successfully, the screen will not "
-					      "be locked."));
-		}
+		manager->priv->lid_lock_pending = TRUE;
+		blpm_screen_locker_lock (manager->priv->screen_locker);
 	    }
 	}
 	else
@@ -491,7 +602,8 @@ blpm_manager_alarm_timeout_cb (EggIdletime *idle, guint id, XfpmManager *manager
 
     if ( id == TIMEOUT_INACTIVITY_ON_AC || id == TIMEOUT_INACTIVITY_ON_BATTERY )
     {
-	XfpmShutdownRequest sleep_mode = XFPM_DO_NOTHING;
+	const XfpmBlconfSettings *settings;
+	XfpmShutdownRequest sleep_mode;
 	gboolean on_battery;
 
 	if ( manager->priv->inhibited )
@@ -500,14 +612,9 @@ blpm_manager_alarm_timeout_cb (EggIdletime *idle, guint id, XfpmManager *manager
 	    return;
 	}
 
-    if ( id == TIMEOUT_INACTIVITY_ON_AC)
-        g_object_get (G_OBJECT (manager->priv->conf),
-                      INACTIVITY_SLEEP_MODE_ON_AC, &sleep_mode,
-                      NULL);
-    else
-        g_object_get (G_OBJECT (manager->priv->conf),
-                      INACTIVITY_SLEEP_MODE_ON_BATTERY, &sleep_mode,
-                      NULL);
+	settings = blpm_blconf_get_settings (manager->priv->conf);
+	sleep_mode = id == TIMEOUT_INACTIVITY_ON_AC ? settings->inactivity_sleep_mode_on_ac
+						    : settings->inactivity_sleep_mode_on_battery;
 
 	g_object_get (G_OBJECT (manager->priv->power),
 		      "on-battery", &on_battery,
@@ -575,6 +682,7 @@ blpm_manager_set_idle_alarm_on_battery (XfpmManager *manager)
 static void
 blpm_manager_on_battery_changed_cb (XfpmPower *power, gboolean on_battery, XfpmManager *manager)
 {
+    egg_idletime_set_on_battery (manager->priv->idle, on_battery);
     egg_idletime_alarm_reset_all (manager->priv->idle);
 }
 
@@ -586,11 +694,14 @@ blpm_manager_set_idle_alarm (XfpmManager *manager)
 
 }
 
+/* How long logind gets to answer an Inhibit() call, in ms */
+#define XFPM_MANAGER_INHIBIT_TIMEOUT 5000
+
 static gchar*
 blpm_manager_get_systemd_events(XfpmManager *manager)
 {
-    GSList *events = NULL;
-    gchar *what = "";
+    const gchar *events[5];
+    guint n = 0;
     gboolean logind_handle_power_key, logind_handle_suspend_key, logind_handle_hibernate_key, logind_handle_lid_switch;
 
     g_object_get (G_OBJECT (manager->priv->conf),
@@ -601,52 +712,107 @@ blpm_manager_get_systemd_events(XfpmManager *manager)
         NULL);
 
     if (!logind_handle_power_key)
-        events = g_slist_append(events, "handle-power-key");
+        events[n++] = "handle-power-key";
     if (!logind_handle_suspend_key)
-        events = g_slist_append(events, "handle-suspend-key");
+        events[n++] = "handle-suspend-key";
     if (!logind_handle_hibernate_key)
-        events = g_slist_append(events, "handle-hibernate-key");
+        events[n++] = "handle-hibernate-key";
     if (!logind_handle_lid_switch)
-        events = g_slist_append(events, "handle-lid-switch");
+        events[n++] = "handle-lid-switch";
+    events[n] = NULL;
 
-    while (events != NULL)
+    return g_strjoinv (":", (gchar **) events);
+}
+
+static void
+blpm_manager_inhibit_sleep_systemd_cancel (XfpmManager *manager)
+{
+    if (manager->priv->inhibit_pending == NULL)
+        return;
+
+    dbus_pending_call_cancel (manager->priv->inhibit_pending);
+    dbus_pending_call_unref (manager->priv->inhibit_pending);
+    manager->priv->inhibit_pending = NULL;
+}
+
+static void
+blpm_manager_inhibit_sleep_systemd_reply (DBusPendingCall *pending, void *data)
+{
+    XfpmManager *manager = data;
+    DBusMessage *reply;
+    DBusError error;
+    gint fd = -1;
+
+    reply = dbus_pending_call_steal_reply (pending);
+
+    dbus_pending_call_unref (manager->priv->inhibit_pending);
+    manager->priv->inhibit_pending = NULL;
+
+    if (reply == NULL)
+        return;
+
+    dbus_error_init (&error);
+
+    if (dbus_set_error_from_message (&error, reply))
+    {
+        g_warning ("Unable to inhibit systemd sleep: %s", error.message);
+    }
+    else if (!dbus_message_get_args (reply, &error,
+                                     DBUS_TYPE_UNIX_FD, &fd,
+                                     DBUS_TYPE_INVALID))
+    {
+        g_warning ("Inhibit() reply parsing failed: %s", error.message);
+    }
+    else
     {
-        if ( g_strcmp0(what, "") == 0 )
-            what = g_strdup( (gchar *) events->data );
-        else
-            what = g_strconcat(what, ":", (gchar *) events->data, NULL);
-        events = g_slist_next(events);
+        /* Only now let go of the old lock, so there is never a moment
+         * where logind handles the events itself */
+        if (manager->priv->inhibit_fd >= 0)
+            close (manager->priv->inhibit_fd);
+        manager->priv->inhibit_fd = fd;
+        XFPM_DEBUG ("Systemd sleep inhibited, fd %d", fd);
     }
-    g_slist_free(events);
 
-    return what;
+    dbus_message_unref (reply);
+    dbus_error_free (&error);
 }
 
-static gint
+/*
+ * Asks logind for a new inhibitor lock for the events we handle. The
+ * current lock is kept until the new one arrives, a failed or timed
+ * out call leaves it in place.
+ */
+static void
 blpm_manager_inhibit_sleep_systemd (XfpmManager *manager)
 {
     DBusConnection *bus_connection;
-    DBusMessage *message = NULL, *reply = NULL;
-    DBusError error;
-    gint fd = -1;
-    const char *what = g_strdup(blpm_manager_get_systemd_events(manager));
+    DBusMessage *message = NULL;
+    gchar *what;
     const char *who = "blade-pm";
     const char *why = "blade-pm handles these events";
     const char *mode = "block";
 
-    if (g_strcmp0(what, "") == 0)
-        return -1;
+    /* a newer request supersedes the one in flight */
+    blpm_manager_inhibit_sleep_systemd_cancel (manager);
 
-    if (!(LOGIND_RUNNING()))
-        return -1;
+    if (!(LOGIND_RUNNING()) || manager->priv->system_bus == NULL)
+        return;
+
+    what = blpm_manager_get_systemd_events (manager);
+
+    if (g_strcmp0(what, "") == 0)
+    {
+        /* logind is to handle everything again */
+        if (manager->priv->inhibit_fd >= 0)
+            close (manager->priv->inhibit_fd);
+        manager->priv->inhibit_fd = -1;
+        g_free (what);
+        return;
+    }
 
     XFPM_DEBUG ("Inhibiting systemd sleep: %s", what);
 
     bus_connection = dbus_g_connection_get_connection (manager->priv->system_bus);
-    if (!blpm_dbus_name_has_owner (bus_connection, "org.freedesktop.login1"))
-        return -1;
-
-    dbus_error_init (&error);
 
     message = dbus_message_new_method_call ("org.freedesktop.login1",
                                             "/org/freedesktop/login1",
@@ -671,40 +837,38 @@ blpm_manager_inhibit_sleep_systemd (XfpmManager *manager)
         goto done;
     }
 
-
-    reply = dbus_connection_send_with_reply_and_block (bus_connection, message, -1, &error);
-    if (!reply)
+    blpm_startup_count_dbus_call ();
+    if (!dbus_connection_send_with_reply (bus_connection, message,
+                                          &manager->priv->inhibit_pending,
+                                          XFPM_MANAGER_INHIBIT_TIMEOUT) ||
+        manager->priv->inhibit_pending == NULL)
     {
-        g_warning ("Unable to inhibit systemd sleep: %s", error.message);
+        g_warning ("Unable to call Inhibit()");
+        manager->priv->inhibit_pending = NULL;
         goto done;
     }
 
-    if (!dbus_message_get_args (reply, &error,
-                                DBUS_TYPE_UNIX_FD, &fd,
-                                DBUS_TYPE_INVALID))
-    {
-        g_warning ("Inhibit() reply parsing failed: %s", error.message);
-    }
+    dbus_pending_call_set_notify (manager->priv->inhibit_pending,
+                                  blpm_manager_inhibit_sleep_systemd_reply,
+                                  manager, NULL);
 
 done:
 
     if (message)
         dbus_message_unref (message);
-    if (reply)
-        dbus_message_unref (reply);
-    dbus_error_free (&error);
-
-    return fd;
+    g_free (what);
 }
 
 static void
 blpm_manager_systemd_events_changed (XfpmManager *manager)
 {
-    if (manager->priv->inhibit_fd >= 0)
-        close (manager->priv->inhibit_fd);
+    blpm_manager_inhibit_sleep_systemd (manager);
+}
 
-    if (manager->priv->system_bus)
-        manager->priv->inhibit_fd = blpm_manager_inhibit_sleep_systemd (manager);
+static void
+blpm_manager_power_state_changed_cb (XfpmPower *power, GHashTable *changed, XfpmManager *manager)
+{
+    g_signal_emit (G_OBJECT (manager), signals [STATE_CHANGED], 0, changed);
 }
 
 static void
@@ -835,19 +999,96 @@ blpm_manager_new (DBusGConnection *bus, const gchar *client_id)
     return manager;
 }
 
+static void
+blpm_manager_init_backlight (XfpmManager *manager)
+{
+    manager->priv->backlight = blpm_backlight_new ();
+    blpm_resume_state_set_backlight (blpm_power_get_resume_state (manager->priv->power),
+				     manager->priv->backlight);
+}
+
+static void
+blpm_manager_init_tray (XfpmManager *manager)
+{
+    if ( manager->priv->show_tray_icon > 0 )
+	blpm_manager_show_tray_icon (manager);
+}
+
+static void
+blpm_manager_init_kbd_backlight (XfpmManager *manager)
+{
+    manager->priv->kbd_backlight = blpm_kbd_backlight_new ();
+    blpm_resume_state_set_kbd_backlight (blpm_power_get_resume_state (manager->priv->power),
+					 manager->priv->kbd_backlight);
+}
+
+/*
+ * Bring up @stage, and whatever it depends on, unless already done.
+ */
+static void
+blpm_manager_ensure_stage (XfpmManager *manager, XfpmManagerStage stage)
+{
+    const XfpmManagerStageInfo *info = &blpm_manager_stages[stage];
+    guint i;
+
+    if ( manager->priv->stages_done & XFPM_MANAGER_STAGE_BIT (stage) )
+	return;
+
+    for ( i = 0; i < XFPM_MANAGER_N_STAGES; i++ )
+    {
+	if ( info->depends & XFPM_MANAGER_STAGE_BIT (i) )
+	    blpm_manager_ensure_stage (manager, i);
+    }
+
+    XFPM_DEBUG ("Starting %s", info->name);
+
+    /* mark first, so the init function sees its own stage as up */
+    manager->priv->stages_done |= XFPM_MANAGER_STAGE_BIT (stage);
+    info->init (manager);
+}
+
+static gboolean
+blpm_manager_stages_idle (gpointer data)
+{
+    XfpmManager *manager = data;
+    guint i;
+
+    /* one stage per slice, so the main loop keeps breathing */
+    for ( i = 0; i < XFPM_MANAGER_N_STAGES; i++ )
+    {
+	if ( !(manager->priv->stages_done & XFPM_MANAGER_STAGE_BIT (i)) )
+	{
+	    blpm_manager_ensure_stage (manager, i);
+	    return TRUE;
+	}
+    }
+
+    manager->priv->stages_id = 0;
+    return FALSE;
+}
+
 void blpm_manager_start (XfpmManager *manager)
 {
     GError *error = NULL;
+    gboolean on_battery;
 
+    blpm_startup_phase_begin ("manager-start");
+
+    blpm_startup_phase_begin ("reserve-names");
     if ( !blpm_manager_reserve_names (manager) )
 	goto out;
+    blpm_startup_phase_end ("reserve-names");
 
     dbus_g_error_domain_register (XFPM_ERROR,
 				  NULL,
 				  XFPM_TYPE_ERROR);
 
     manager->priv->power = blpm_power_get ();
+
+    blpm_startup_phase_begin ("button");
     manager->priv->button = blpm_button_new ();
+    blpm_startup_phase_end ("button");
+
     manager->priv->conf = blpm_blconf_new ();
     manager->priv->console = NULL;
     manager->priv->systemd = NULL;
@@ -861,16 +1102,23 @@ void blpm_manager_start (XfpmManager *manager)
     manager->priv->inhibit = blpm_inhibit_new ();
     manager->priv->idle = egg_idletime_new ();
 
+    g_object_get (G_OBJECT (manager->priv->power),
+		  "on-battery", &on_battery,
+		  NULL);
+    egg_idletime_set_on_battery (manager->priv->idle, on_battery);
+
     /* Don't allow systemd to handle power/suspend/hibernate buttons
      * and lid-switch */
+    blpm_startup_phase_begin ("logind-inhibit");
     manager->priv->system_bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
     if (manager->priv->system_bus)
-        manager->priv->inhibit_fd = blpm_manager_inhibit_sleep_systemd (manager);
+        blpm_manager_inhibit_sleep_systemd (manager);
     else
     {
         g_warning ("Unable connect to system bus: %s", error->message);
         g_clear_error (&error);
     }
+    blpm_startup_phase_end ("logind-inhibit");
 
     g_signal_connect (manager->priv->idle, "alarm-expired",
 		      G_CALLBACK (blpm_manager_alarm_timeout_cb), manager);
@@ -901,12 +1149,12 @@ void blpm_manager_start (XfpmManager *manager)
     g_signal_connect (manager->priv->monitor, "system-bus-connection-changed",
 		      G_CALLBACK (blpm_manager_system_bus_connection_changed_cb), manager);
 
-    manager->priv->backlight = blpm_backlight_new ();
-
-    manager->priv->kbd_backlight = blpm_kbd_backlight_new ();
-
     manager->priv->dpms = blpm_dpms_new ();
 
+    manager->priv->screen_locker = blpm_screen_locker_new ();
+    g_signal_connect (manager->priv->screen_locker, "lock-finished",
+		      G_CALLBACK (blpm_manager_lock_finished_cb), manager);
+
     g_signal_connect (manager->priv->button, "button_pressed",
 		      G_CALLBACK (blpm_manager_button_pressed_cb), manager);
 
@@ -922,6 +1170,9 @@ void blpm_manager_start (XfpmManager *manager)
     g_signal_connect_swapped (manager->priv->power, "sleeping",
 			      G_CALLBACK (blpm_manager_reset_sleep_timer), manager);
 
+    g_signal_connect (manager->priv->power, "state-changed",
+		      G_CALLBACK (blpm_manager_power_state_changed_cb), manager);
+
     g_signal_connect_swapped (manager->priv->power, "ask-shutdown",
 			      G_CALLBACK (blpm_manager_ask_shutdown), manager);
 
@@ -933,8 +1184,10 @@ void blpm_manager_start (XfpmManager *manager)
 			   G_TYPE_INT,
                            G_OBJECT(manager),
 			   SHOW_TRAY_ICON_CFG);
+
+    manager->priv->stages_id = g_idle_add_full (G_PRIORITY_LOW, blpm_manager_stages_idle, manager, NULL);
 out:
-	;
+    blpm_startup_phase_end ("manager-start");
 }
 
 void blpm_manager_stop (XfpmManager *manager)
@@ -944,6 +1197,34 @@ void blpm_manager_stop (XfpmManager *manager)
     blpm_manager_quit (manager);
 }
 
+static gchar *
+blpm_manager_idle_histogram_to_string (XfpmManager *manager, EggIdletimeHistogram which)
+{
+    GString *str;
+    const guint *histogram;
+    guint i;
+
+    histogram = egg_idletime_get_histogram (manager->priv->idle, which);
+    str = g_string_new (NULL);
+
+    for ( i = 0; i < EGG_IDLETIME_HISTOGRAM_BUCKETS; i++ )
+	g_string_append_printf (str, i == 0 ? "%u" : " %u", histogram[i]);
+
+    return g_string_free (str, FALSE);
+}
+
+static GArray *
+blpm_manager_idle_histogram_to_array (XfpmManager *manager, EggIdletimeHistogram which)
+{
+    GArray *array;
+
+    array = g_array_sized_new (FALSE, FALSE, sizeof (guint), EGG_IDLETIME_HISTOGRAM_BUCKETS);
+    g_array_append_vals (array,
+			 egg_idletime_get_histogram (manager->priv->idle, which),
+			 EGG_IDLETIME_HISTOGRAM_BUCKETS);
+    return array;
+}
+
 GHashTable *blpm_manager_get_config (XfpmManager *manager)
 {
     GHashTable *hash;
@@ -985,6 +1266,8 @@ GHashTable *blpm_manager_get_config (XfpmManager *manager)
 		  NULL);
 
     has_battery = blpm_power_has_battery (manager->priv->power);
+
+    blpm_manager_ensure_stage (manager, XFPM_MANAGER_STAGE_BACKLIGHT);
     has_lcd_brightness = blpm_backlight_has_hw (manager->priv->backlight);
 
     mapped_buttons = blpm_button_get_mapped (manager->priv->button);
@@ -1010,6 +1293,16 @@ GHashTable *blpm_manager_get_config (XfpmManager *manager)
 
     g_hash_table_insert (hash, g_strdup ("has-brightness"), g_strdup (blpm_bool_to_string (has_lcd_brightness)));
 
+    g_hash_table_insert (hash, g_strdup ("idle-histogram-on-ac"),
+			 blpm_manager_idle_histogram_to_string (manager, EGG_IDLETIME_HISTOGRAM_ON_AC));
+    g_hash_table_insert (hash, g_strdup ("idle-histogram-on-battery"),
+			 blpm_manager_idle_histogram_to_string (manager, EGG_IDLETIME_HISTOGRAM_ON_BATTERY));
+    g_hash_table_insert (hash, g_strdup ("startup-trace"), blpm_startup_trace_to_string ());
+    g_hash_table_insert (hash, g_strdup ("resume-latency"),
+			 g_strdup_printf ("%.1f", blpm_power_get_resume_latency (manager->priv->power)));
+    g_hash_table_insert (hash, g_strdup ("sleep-timings"),
+			 blpm_power_sleep_timings_to_string (manager->priv->power));
+
     return hash;
 }
 
@@ -1034,6 +1327,23 @@ static gboolean blpm_manager_dbus_get_info   (XfpmManager *manager,
 					      gchar **OUT_vendor,
 					      GError **error);
 
+static gboolean blpm_manager_dbus_get_idle_histogram (XfpmManager *manager,
+						      GArray **OUT_on_ac,
+						      GArray **OUT_on_battery,
+						      GError **error);
+
+static gboolean blpm_manager_dbus_get_sleep_timings (XfpmManager *manager,
+						     gchar **OUT_timings,
+						     GError **error);
+
+static gboolean blpm_manager_dbus_get_trace (XfpmManager *manager,
+					     gchar **OUT_trace,
+					     GError **error);
+
+static gboolean blpm_manager_dbus_get_all (XfpmManager *manager,
+					   GHashTable **OUT_state,
+					   GError **error);
+
 #include "blade-pm-dbus-server.h"
 
 static void
@@ -1096,3 +1406,45 @@ blpm_manager_dbus_get_info (XfpmManager *manager,
 
     return TRUE;
 }
+
+static gboolean
+blpm_manager_dbus_get_idle_histogram (XfpmManager *manager,
+				      GArray **OUT_on_ac,
+				      GArray **OUT_on_battery,
+				      GError **error)
+{
+    *OUT_on_ac      = blpm_manager_idle_histogram_to_array (manager, EGG_IDLETIME_HISTOGRAM_ON_AC);
+    *OUT_on_battery = blpm_manager_idle_histogram_to_array (manager, EGG_IDLETIME_HISTOGRAM_ON_BATTERY);
+
+    return TRUE;
+}
+
+static gboolean
+blpm_manager_dbus_get_sleep_timings (XfpmManager *manager,
+				     gchar **OUT_timings,
+				     GError **error)
+{
+    *OUT_timings = blpm_power_sleep_timings_to_string (manager->priv->power);
+
+    return TRUE;
+}
+
+static gboolean
+blpm_manager_dbus_get_trace (XfpmManager *manager,
+			     gchar **OUT_trace,
+			     GError **error)
+{
+    *OUT_trace = blpm_trace_to_string ();
+
+    return TRUE;
+}
+
+static gboolean
+blpm_manager_dbus_get_all (XfpmManager *manager,
+			   GHashTable **OUT_state,
+			   GError **error)
+{
+    *OUT_state = blpm_power_get_state (manager->priv->power);
+
+    return TRUE;
+}
@@ -26,45 +26,253 @@
 #include <dbus/dbus-glib.h>
 
 #include "blpm-network-manager.h"
+#include "blpm-debug.h"
 
-/*
- * Inform the Network Manager when we do suspend/hibernate 
- */
-gboolean 	blpm_network_manager_sleep  	(gboolean sleep)
+static void blpm_network_manager_finalize   (GObject *object);
+
+#define XFPM_NETWORK_MANAGER_GET_PRIVATE(o) \
+(G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_NETWORK_MANAGER, XfpmNetworkManagerPrivate))
+
+/* NM_STATE_ASLEEP, NetworkManager 0.8 and 0.9 or later */
+#define NM_STATE_ASLEEP_08	1
+#define NM_STATE_ASLEEP		10
+
+#define NM_STATE_IS_ASLEEP(state) ((state) == NM_STATE_ASLEEP || (state) == NM_STATE_ASLEEP_08)
+
+struct XfpmNetworkManagerPrivate
 {
+    DBusGConnection *bus;
+    DBusGProxy      *proxy;
+    
+    guint            state;
+    
+    DBusGProxyCall  *state_call;
+    DBusGProxyCall  *sleep_call;
+    
+    /* Sleep (TRUE) was sent and NM hasn't reported asleep yet */
+    gboolean         sleep_pending;
+};
+
+enum
+{
+    SLEEP_FINISHED,
+    LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE (XfpmNetworkManager, blpm_network_manager, G_TYPE_OBJECT)
+
 #ifdef WITH_NETWORK_MANAGER
+static void
+blpm_network_manager_sleep_finished (XfpmNetworkManager *nm)
+{
+    if ( !nm->priv->sleep_pending )
+	return;
+	
+    nm->priv->sleep_pending = FALSE;
+    g_signal_emit (G_OBJECT (nm), signals [SLEEP_FINISHED], 0);
+}
 
-    DBusGConnection *bus   = NULL;
-    DBusGProxy      *proxy = NULL;
-    GError          *error = NULL;
+static void
+blpm_network_manager_state_changed_cb (DBusGProxy *proxy, guint state, XfpmNetworkManager *nm)
+{
+    XFPM_DEBUG ("NetworkManager state %u", state);
     
-    bus = dbus_g_bus_get ( DBUS_BUS_SYSTEM, &error);
+    nm->priv->state = state;
+    
+    if ( NM_STATE_IS_ASLEEP (state) )
+	blpm_network_manager_sleep_finished (nm);
+}
+
+static void
+blpm_network_manager_state_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmNetworkManager *nm = data;
+    GError *error = NULL;
+    guint state;
+    
+    nm->priv->state_call = NULL;
+    
+    if ( !dbus_g_proxy_end_call (proxy, call, &error,
+				 G_TYPE_UINT, &state,
+				 G_TYPE_INVALID) )
+    {
+	XFPM_DEBUG ("Unable to get the NetworkManager state: %s", error->message);
+	g_error_free (error);
+	return;
+    }
+    
+    /* A StateChanged may have been seen while we waited */
+    if ( nm->priv->state == 0 )
+	nm->priv->state = state;
+}
+
+static void
+blpm_network_manager_sleep_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmNetworkManager *nm = data;
+    GError *error = NULL;
+    
+    nm->priv->sleep_call = NULL;
+    
+    if ( !dbus_g_proxy_end_call (proxy, call, &error, G_TYPE_INVALID) )
+    {
+	/* Not running or refused, there is nothing to wait for */
+	XFPM_DEBUG ("NetworkManager Sleep failed: %s", error->message);
+	g_error_free (error);
+	blpm_network_manager_sleep_finished (nm);
+    }
+}
+#endif /* WITH_NETWORK_MANAGER */
+
+static void
+blpm_network_manager_class_init (XfpmNetworkManagerClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    signals [SLEEP_FINISHED] =
+    	g_signal_new ("sleep-finished",
+		      XFPM_TYPE_NETWORK_MANAGER,
+		      G_SIGNAL_RUN_LAST,
+		      G_STRUCT_OFFSET (XfpmNetworkManagerClass, sleep_finished),
+		      NULL, NULL,
+		      g_cclosure_marshal_VOID__VOID,
+		      G_TYPE_NONE, 0);
+
+    object_class->finalize = blpm_network_manager_finalize;
+
+    g_type_class_add_private (klass, sizeof (XfpmNetworkManagerPrivate));
+}
+
+static void
+blpm_network_manager_init (XfpmNetworkManager *nm)
+{
+#ifdef WITH_NETWORK_MANAGER
+    GError *error = NULL;
+#endif
+
+    nm->priv = XFPM_NETWORK_MANAGER_GET_PRIVATE (nm);
+    
+    nm->priv->bus   = NULL;
+    nm->priv->proxy = NULL;
+    nm->priv->state = 0;
+
+#ifdef WITH_NETWORK_MANAGER
+    nm->priv->bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
     
     if ( error )
     {
-	g_warning("%s", error->message);
+	g_warning ("%s", error->message);
 	g_error_free (error);
-	return FALSE;
+	return;
     }
     
-    proxy = dbus_g_proxy_new_for_name (bus,
-				       "org.freedesktop.NetworkManager",
-				       "/org/freedesktop/NetworkManager",
-				       "org.freedesktop.NetworkManager");
+    /* follows the name, so NetworkManager may come and go */
+    nm->priv->proxy = dbus_g_proxy_new_for_name (nm->priv->bus,
+						 "org.freedesktop.NetworkManager",
+						 "/org/freedesktop/NetworkManager",
+						 "org.freedesktop.NetworkManager");
 				       
-    if (!proxy)
+    if ( !nm->priv->proxy )
     {
 	g_warning ("Failed to create proxy for Network Manager interface");
+	return;
+    }
+    
+    dbus_g_proxy_add_signal (nm->priv->proxy, "StateChanged", G_TYPE_UINT, G_TYPE_INVALID);
+    dbus_g_proxy_connect_signal (nm->priv->proxy, "StateChanged",
+				 G_CALLBACK (blpm_network_manager_state_changed_cb), nm, NULL);
+    
+    nm->priv->state_call = dbus_g_proxy_begin_call (nm->priv->proxy, "state",
+						    blpm_network_manager_state_reply,
+						    nm, NULL,
+						    G_TYPE_INVALID);
+#endif /* WITH_NETWORK_MANAGER */
+}
+
+static void
+blpm_network_manager_finalize (GObject *object)
+{
+    XfpmNetworkManager *nm;
+
+    nm = XFPM_NETWORK_MANAGER (object);
+    
+    if ( nm->priv->proxy )
+    {
+#ifdef WITH_NETWORK_MANAGER
+	dbus_g_proxy_disconnect_signal (nm->priv->proxy, "StateChanged",
+					G_CALLBACK (blpm_network_manager_state_changed_cb), nm);
+#endif
+	if ( nm->priv->state_call )
+	    dbus_g_proxy_cancel_call (nm->priv->proxy, nm->priv->state_call);
+	if ( nm->priv->sleep_call )
+	    dbus_g_proxy_cancel_call (nm->priv->proxy, nm->priv->sleep_call);
+	g_object_unref (nm->priv->proxy);
+    }
+    
+    if ( nm->priv->bus )
+	dbus_g_connection_unref (nm->priv->bus);
+
+    G_OBJECT_CLASS (blpm_network_manager_parent_class)->finalize (object);
+}
+
+XfpmNetworkManager *
+blpm_network_manager_new (void)
+{
+    static gpointer nm_obj = NULL;
+    
+    if ( G_LIKELY (nm_obj != NULL ) )
+    {
+	g_object_ref (nm_obj);
+    }
+    else
+    {
+	nm_obj = g_object_new (XFPM_TYPE_NETWORK_MANAGER, NULL);
+	g_object_add_weak_pointer (nm_obj, &nm_obj);
+    }
+    
+    return XFPM_NETWORK_MANAGER (nm_obj);
+}
+
+/*
+ * Inform the Network Manager when we do suspend/hibernate.
+ *
+ * Returns TRUE when going to sleep and NetworkManager still has to
+ * report it is asleep, "sleep-finished" is emitted once it did or
+ * once the request failed.
+ */
+gboolean
+blpm_network_manager_sleep (XfpmNetworkManager *nm, gboolean sleep)
+{
+    g_return_val_if_fail (XFPM_IS_NETWORK_MANAGER (nm), FALSE);
+
+#ifdef WITH_NETWORK_MANAGER
+    if ( !nm->priv->proxy )
 	return FALSE;
+    
+    if ( nm->priv->sleep_call )
+    {
+	dbus_g_proxy_cancel_call (nm->priv->proxy, nm->priv->sleep_call);
+	nm->priv->sleep_call = NULL;
     }
     
-    dbus_g_proxy_call_no_reply (proxy, "Sleep", G_TYPE_BOOLEAN, sleep, G_TYPE_INVALID);
-    g_object_unref (G_OBJECT(proxy));
-    dbus_g_connection_unref (bus);
+    if ( !sleep )
+    {
+	nm->priv->sleep_pending = FALSE;
+	dbus_g_proxy_call_no_reply (nm->priv->proxy, "Sleep", G_TYPE_BOOLEAN, FALSE, G_TYPE_INVALID);
+	return FALSE;
+    }
     
-    /* Sleep 0.5 second to allow the nm applet to disconnect*/
-    g_usleep (500000);
+    nm->priv->sleep_pending = !NM_STATE_IS_ASLEEP (nm->priv->state);
+    nm->priv->sleep_call = dbus_g_proxy_begin_call (nm->priv->proxy, "Sleep",
+						    blpm_network_manager_sleep_reply,
+						    nm, NULL,
+						    G_TYPE_BOOLEAN, TRUE,
+						    G_TYPE_INVALID);
     
+    return nm->priv->sleep_pending;
+#else
+    return FALSE;
 #endif /* WITH_NETWORK_MANAGER */
-    return TRUE;
 }
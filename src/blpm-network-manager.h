@@ -21,9 +21,37 @@
 #ifndef __XFPM_NETWORK_MANAGER_H
 #define __XFPM_NETWORK_MANAGER_H
 
+#include <glib-object.h>
+
 G_BEGIN_DECLS
 
-gboolean 	blpm_network_manager_sleep 	(gboolean sleep);
+#define XFPM_TYPE_NETWORK_MANAGER        (blpm_network_manager_get_type () )
+#define XFPM_NETWORK_MANAGER(o)          (G_TYPE_CHECK_INSTANCE_CAST ((o), XFPM_TYPE_NETWORK_MANAGER, XfpmNetworkManager))
+#define XFPM_IS_NETWORK_MANAGER(o)       (G_TYPE_CHECK_INSTANCE_TYPE ((o), XFPM_TYPE_NETWORK_MANAGER))
+
+typedef struct XfpmNetworkManagerPrivate XfpmNetworkManagerPrivate;
+
+typedef struct
+{
+    GObject         		parent;
+    XfpmNetworkManagerPrivate  *priv;
+    
+} XfpmNetworkManager;
+
+typedef struct
+{
+    GObjectClass 		parent_class;
+    
+    void                        (*sleep_finished)	(XfpmNetworkManager *nm);
+    
+} XfpmNetworkManagerClass;
+
+GType        			blpm_network_manager_get_type    (void) G_GNUC_CONST;
+
+XfpmNetworkManager	       *blpm_network_manager_new         (void);
+
+gboolean 			blpm_network_manager_sleep 	 (XfpmNetworkManager *nm,
+								  gboolean sleep);
 
 G_END_DECLS
 
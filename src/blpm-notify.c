@@ -55,12 +55,56 @@ static NotifyNotification * blpm_notify_new_notification_internal (const gchar *
 								   XfpmNotifyUrgency urgency, 
 								   GtkStatusIcon *icon) G_GNUC_MALLOC;
 
+static void blpm_notify_queue_clear (XfpmNotify *notify);
+
 #define XFPM_NOTIFY_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE((o), XFPM_TYPE_NOTIFY, XfpmNotifyPrivate))
 
+/* token bucket limiting the notifications sent to the server */
+#define XFPM_NOTIFY_BURST		4
+#define XFPM_NOTIFY_REFILL_MS		1000
+
+/* latest request per category, sent when the category window closes */
+typedef struct
+{
+    XfpmNotify         *notify;
+    XfpmNotifyCategory  category;
+    guint               id;		/* the window, one per category */
+
+    gboolean            pending;
+    gchar              *title;
+    gchar              *text;
+    gchar              *icon_name;
+    gint                timeout;
+    gint                value;		/* -1 for no value hint */
+    XfpmNotifyUrgency   urgency;
+    GtkStatusIcon      *icon;
+
+    NotifyNotification *n;		/* reused for value popups */
+
+} XfpmNotifyQueueEntry;
+
+typedef struct
+{
+    const gchar *name;
+    guint        window;		/* ms to collect updates for */
+
+} XfpmNotifyCategoryInfo;
+
+static const XfpmNotifyCategoryInfo blpm_notify_categories [XFPM_NOTIFY_N_CATEGORIES] =
+{
+    { "power-state",         500 },
+    { "brightness",           80 },
+    { "keyboard-brightness",  80 }
+};
+
 struct XfpmNotifyPrivate
 {
     XfpmDBusMonitor    *monitor;
+
+    XfpmNotifyQueueEntry queue[XFPM_NOTIFY_N_CATEGORIES];
+    gdouble             tokens;
+    gint64              tokens_time;
     
     NotifyNotification *notification;
     NotifyNotification *critical;
@@ -70,6 +114,7 @@ struct XfpmNotifyPrivate
     
     gboolean	        supports_actions;
     gboolean		supports_sync; /* For x-canonical-private-synchronous */
+    gboolean		caps_valid;    /* server asked since it (re)appeared */
 };
 
 enum
@@ -85,6 +130,11 @@ static void
 blpm_notify_get_server_caps (XfpmNotify *notify)
 {
     GList *caps = NULL;
+
+    if ( notify->priv->caps_valid )
+	return;
+
+    notify->priv->caps_valid       = TRUE;
     notify->priv->supports_actions = FALSE;
     notify->priv->supports_sync    = FALSE;
     
@@ -110,8 +160,9 @@ blpm_notify_check_server (XfpmDBusMonitor *monitor,
 			  gboolean on_session,
 			  XfpmNotify *notify)
 {
+    /* ask again the next time somebody wants to know */
     if ( !g_strcmp0 (service_name, "org.freedesktop.Notifications") && on_session && connected )
-	blpm_notify_get_server_caps (notify);
+	notify->priv->caps_valid = FALSE;
 }
 
 static void blpm_notify_get_property (GObject *object,
@@ -122,6 +173,8 @@ static void blpm_notify_get_property (GObject *object,
     XfpmNotify *notify;
     
     notify = XFPM_NOTIFY (object);
+
+    blpm_notify_get_server_caps (notify);
     
     switch (prop_id)
     {
@@ -165,6 +218,8 @@ blpm_notify_class_init (XfpmNotifyClass *klass)
 static void
 blpm_notify_init (XfpmNotify *notify)
 {
+    guint i;
+
     notify->priv = XFPM_NOTIFY_GET_PRIVATE (notify);
     
     notify->priv->notification = NULL;
@@ -177,8 +232,18 @@ blpm_notify_init (XfpmNotify *notify)
     blpm_dbus_monitor_add_service (notify->priv->monitor, DBUS_BUS_SESSION, "org.freedesktop.Notifications");
     g_signal_connect (notify->priv->monitor, "service-connection-changed",
 		      G_CALLBACK (blpm_notify_check_server), notify);
-    
-    blpm_notify_get_server_caps (notify);
+
+    /* the server is only asked for its capabilities when they are needed */
+    notify->priv->caps_valid = FALSE;
+
+    for ( i = 0; i < XFPM_NOTIFY_N_CATEGORIES; i++ )
+    {
+	notify->priv->queue[i].notify = notify;
+	notify->priv->queue[i].category = i;
+    }
+
+    notify->priv->tokens = XFPM_NOTIFY_BURST;
+    notify->priv->tokens_time = g_get_monotonic_time ();
 }
 
 static void
@@ -188,6 +253,7 @@ blpm_notify_finalize (GObject *object)
 
     notify = XFPM_NOTIFY (object);
     
+    blpm_notify_queue_clear (notify);
     blpm_notify_close_normal (notify);
     blpm_notify_close_critical (notify);
     
@@ -287,6 +353,178 @@ blpm_notify_close_notification (XfpmNotify *notify )
     }
 }
 
+static void
+blpm_notify_queue_entry_reset (XfpmNotifyQueueEntry *entry)
+{
+    g_free (entry->title);
+    g_free (entry->text);
+    g_free (entry->icon_name);
+
+    if ( entry->icon != NULL )
+	g_object_unref (entry->icon);
+
+    entry->title     = NULL;
+    entry->text      = NULL;
+    entry->icon_name = NULL;
+    entry->icon      = NULL;
+    entry->pending   = FALSE;
+}
+
+/* drop what is queued and stop its window */
+static void
+blpm_notify_queue_entry_cancel (XfpmNotifyQueueEntry *entry)
+{
+    if ( entry->id != 0 )
+    {
+	g_source_remove (entry->id);
+	entry->id = 0;
+    }
+
+    blpm_notify_queue_entry_reset (entry);
+}
+
+static void
+blpm_notify_queue_clear (XfpmNotify *notify)
+{
+    guint i;
+
+    for ( i = 0; i < XFPM_NOTIFY_N_CATEGORIES; i++ )
+    {
+	blpm_notify_queue_entry_cancel (&notify->priv->queue[i]);
+
+	if ( notify->priv->queue[i].n != NULL )
+	{
+	    g_object_unref (notify->priv->queue[i].n);
+	    notify->priv->queue[i].n = NULL;
+	}
+    }
+}
+
+/*
+ * Refill the bucket for the time that passed and try to take a token.
+ */
+static gboolean
+blpm_notify_take_token (XfpmNotify *notify)
+{
+    gint64 now;
+
+    now = g_get_monotonic_time ();
+    notify->priv->tokens += (gdouble) (now - notify->priv->tokens_time) / (XFPM_NOTIFY_REFILL_MS * 1000);
+    notify->priv->tokens = MIN (notify->priv->tokens, XFPM_NOTIFY_BURST);
+    notify->priv->tokens_time = now;
+
+    if ( notify->priv->tokens < 1.0 )
+	return FALSE;
+
+    notify->priv->tokens -= 1.0;
+    return TRUE;
+}
+
+static void
+blpm_notify_send_entry (XfpmNotify *notify, XfpmNotifyCategory category)
+{
+    XfpmNotifyQueueEntry *entry = &notify->priv->queue[category];
+    NotifyNotification *n;
+
+    if ( category == XFPM_NOTIFY_CATEGORY_STATE )
+    {
+	blpm_notify_close_notification (notify);
+
+	n = blpm_notify_new_notification_internal (entry->title, entry->text,
+						   entry->icon_name, entry->timeout,
+						   entry->urgency, entry->icon);
+	g_signal_connect (G_OBJECT(n),"closed",
+			  G_CALLBACK(blpm_notify_closed_cb), notify);
+	notify->priv->notification = n;
+    }
+    else
+    {
+	/* update the popup in place, the server replaces what it shows */
+	if ( entry->n == NULL )
+	    entry->n = blpm_notify_new_notification_internal ("", "",
+							      entry->icon_name, 0,
+							      XFPM_NOTIFY_NORMAL, NULL);
+	n = entry->n;
+
+	notify_notification_update (n, entry->title, NULL, NULL);
+
+	if ( entry->value >= 0 )
+	    notify_notification_set_hint_int32 (n, "value", entry->value);
+
+	blpm_notify_get_server_caps (notify);
+	if ( notify->priv->supports_sync )
+	    notify_notification_set_hint_string (n, "x-canonical-private-synchronous",
+						 blpm_notify_categories[category].name);
+    }
+
+    blpm_notify_queue_entry_reset (entry);
+
+    notify_notification_show (n, NULL);
+}
+
+static gboolean
+blpm_notify_queue_flush (gpointer data)
+{
+    XfpmNotifyQueueEntry *entry = data;
+    XfpmNotify *notify = entry->notify;
+    guint delay;
+
+    entry->id = 0;
+
+    if ( !entry->pending )
+	return FALSE;
+
+    if ( !blpm_notify_take_token (notify) )
+    {
+	/* come back when the next token is there, whatever arrives
+	 * meanwhile just replaces what is queued */
+	delay = (1.0 - notify->priv->tokens) * XFPM_NOTIFY_REFILL_MS;
+	entry->id = g_timeout_add (MAX (delay, 1), blpm_notify_queue_flush, entry);
+	return FALSE;
+    }
+
+    blpm_notify_send_entry (notify, entry->category);
+
+    return FALSE;
+}
+
+static void
+blpm_notify_queue (XfpmNotify *notify, XfpmNotifyCategory category,
+		   const gchar *title, const gchar *text, const gchar *icon_name,
+		   gint timeout, gint value, XfpmNotifyUrgency urgency, GtkStatusIcon *icon)
+{
+    XfpmNotifyQueueEntry *entry = &notify->priv->queue[category];
+
+    /* a newer update of the same category supersedes the queued one */
+    blpm_notify_queue_entry_reset (entry);
+
+    entry->pending   = TRUE;
+    entry->title     = g_strdup (title);
+    entry->text      = g_strdup (text);
+    entry->icon_name = g_strdup (icon_name);
+    entry->timeout   = timeout;
+    entry->value     = value;
+    entry->urgency   = urgency;
+    entry->icon      = icon != NULL ? g_object_ref (icon) : NULL;
+
+    /* critical messages are never held back, nor rate limited */
+    if ( urgency == XFPM_NOTIFY_CRITICAL )
+    {
+	if ( entry->id != 0 )
+	{
+	    g_source_remove (entry->id);
+	    entry->id = 0;
+	}
+	blpm_notify_take_token (notify);
+	blpm_notify_send_entry (notify, category);
+	return;
+    }
+
+    if ( entry->id == 0 )
+	entry->id = g_timeout_add (blpm_notify_categories[category].window,
+				   blpm_notify_queue_flush, entry);
+}
+
 XfpmNotify *
 blpm_notify_new (void)
 {
@@ -311,8 +549,13 @@ void blpm_notify_show_notification (XfpmNotify *notify, const gchar *title,
 {
     NotifyNotification *n;
     
+    /* replacing notifications go through the queue */
     if ( !simple )
-        blpm_notify_close_notification (notify);
+    {
+	blpm_notify_queue (notify, XFPM_NOTIFY_CATEGORY_STATE, title, text,
+			   icon_name, timeout, -1, urgency, icon);
+	return;
+    }
     
     n = blpm_notify_new_notification_internal (title, 
 				               text, icon_name, 
@@ -322,6 +565,20 @@ void blpm_notify_show_notification (XfpmNotify *notify, const gchar *title,
     blpm_notify_present_notification (notify, n, simple);
 }
 
+/*
+ * Show a popup with a value hint (brightness and the like). Updates
+ * arriving in quick succession are merged into one.
+ */
+void blpm_notify_show_value (XfpmNotify *notify, XfpmNotifyCategory category,
+			     const gchar *summary, const gchar *icon_name, gint value)
+{
+    g_return_if_fail (XFPM_IS_NOTIFY (notify));
+    g_return_if_fail (category != XFPM_NOTIFY_CATEGORY_STATE && category < XFPM_NOTIFY_N_CATEGORIES);
+
+    blpm_notify_queue (notify, category, summary, NULL, icon_name,
+		       0, value, XFPM_NOTIFY_NORMAL, NULL);
+}
+
 NotifyNotification *blpm_notify_new_notification (XfpmNotify *notify,
 						  const gchar *title,
 						  const gchar *text,
@@ -405,5 +662,7 @@ void blpm_notify_close_normal  (XfpmNotify *notify)
 {
     g_return_if_fail (XFPM_IS_NOTIFY (notify));
     
+    /* nothing queued should pop up after this */
+    blpm_notify_queue_entry_cancel (&notify->priv->queue[XFPM_NOTIFY_CATEGORY_STATE]);
     blpm_notify_close_notification (notify);
 }
@@ -40,6 +40,16 @@ typedef enum
     
 } XfpmNotifyUrgency;
 
+/* Notifications of one category replace each other */
+typedef enum
+{
+    XFPM_NOTIFY_CATEGORY_STATE = 0,	/* power and battery state messages */
+    XFPM_NOTIFY_CATEGORY_BRIGHTNESS,	/* display brightness popup */
+    XFPM_NOTIFY_CATEGORY_KBD_BRIGHTNESS,	/* keyboard brightness popup */
+    XFPM_NOTIFY_N_CATEGORIES
+
+} XfpmNotifyCategory;
+
 typedef struct XfpmNotifyPrivate XfpmNotifyPrivate;
 
 typedef struct
@@ -86,6 +96,12 @@ void 			  blpm_notify_present_notification 	    (XfpmNotify *notify,
 								     NotifyNotification *n,
 								     gboolean simple);
 								     
+void                      blpm_notify_show_value                    (XfpmNotify *notify,
+								     XfpmNotifyCategory category,
+								     const gchar *summary,
+								     const gchar *icon_name,
+								     gint value);
+
 void                      blpm_notify_critical                      (XfpmNotify *notify,
 								     NotifyNotification *n);
 
@@ -57,10 +57,15 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #include <dbus/dbus-glib.h>
 
 #include "blpm-polkit.h"
 #include "blpm-debug.h"
+#include "blpm-marshal.h"
 
 #include "blpm-common.h"
 
@@ -83,14 +88,35 @@ struct XfpmPolkitPrivate
     GType              details_gtype;
     GType              result_gtype;
 
-    gulong             destroy_id;
     gboolean           subject_valid;
+
+    GHashTable        *cache;
+    guint              generation;
 #endif
 };
 
+#ifdef ENABLE_POLKIT
+typedef enum
+{
+    XFPM_POLKIT_AUTH_PENDING = 1,
+    XFPM_POLKIT_AUTH_NO,
+    XFPM_POLKIT_AUTH_YES
+
+} XfpmPolkitAuthState;
+
+typedef struct
+{
+    XfpmPolkit        *polkit;
+    gchar             *action_id;
+    guint              generation;
+
+} XfpmPolkitCall;
+#endif
+
 enum
 {
     AUTH_CHANGED,
+    AUTH_RESULT,
     LAST_SIGNAL
 };
 
@@ -131,62 +157,60 @@ get_start_time_for_pid (pid_t pid)
 {
     guint64 start_time = 0;
 #if defined(__linux)
-    gchar *filename;
-    gchar *contents;
-    size_t length;
-    gchar **tokens;
-    guint num_tokens;
+    gchar filename[32];
+    gchar contents[1024];
+    gssize length;
     gchar *p;
     gchar *endp;
-  
-    start_time = 0;
-    contents = NULL;
-    
-    filename = g_strdup_printf ("/proc/%d/stat", pid);
-    
-    if (!g_file_get_contents (filename, &contents, &length, NULL))
+    guint field;
+    int fd;
+
+    g_snprintf (filename, sizeof (filename), "/proc/%d/stat", (int) pid);
+
+    if ((fd = open (filename, O_RDONLY)) < 0)
 	goto out;
 
+    length = read (fd, contents, sizeof (contents) - 1);
+    close (fd);
+
+    if (length <= 0)
+	goto out;
+
+    contents[length] = '\0';
+
     /* start time is the token at index 19 after the '(process name)' entry - since only this
      * field can contain the ')' character, search backwards for this to avoid malicious
      * processes trying to fool us
      */
     p = strrchr (contents, ')');
     if (p == NULL)
-    {
-	goto out;
-    }
-    
-    p += 2; /* skip ') ' */
-
-    if (p - contents >= (int) length)
     {
 	g_warning ("Error parsing file %s", filename);
 	goto out;
     }
-    
-    tokens = g_strsplit (p, " ", 0);
-    
-    num_tokens = g_strv_length (tokens);
-    
-    if (num_tokens < 20)
+
+    /* walk over the ' ' separated fields in place instead of splitting the line */
+    for (field = 0; field < 20; field++)
     {
-	g_warning ("Error parsing file %s", filename);
-	goto out;
+	p = strchr (p + 1, ' ');
+	if (p == NULL)
+	{
+	    g_warning ("Error parsing file %s", filename);
+	    goto out;
+	}
     }
+    p++;
 
-    start_time = strtoull (tokens[19], &endp, 10);
-    if (endp == tokens[19])
+    start_time = g_ascii_strtoull (p, &endp, 10);
+    if (endp == p)
     {
 	g_warning ("Error parsing file %s", filename);
-	goto out;
+	start_time = 0;
     }
-    g_strfreev (tokens);
 
  out:
-    g_free (filename);
-    g_free (contents);
-    
+    ;
+
 #elif defined(__FreeBSD__)
 
     struct kinfo_proc p;
@@ -239,13 +263,18 @@ out:
 
 
 #ifdef ENABLE_POLKIT
-static gboolean
-blpm_polkit_free_data (gpointer data)
+static void
+blpm_polkit_free_value (gpointer data)
 {
-    XfpmPolkit *polkit;
-    
-    polkit = XFPM_POLKIT (data);
+    GValue *value = data;
+
+    g_value_unset (value);
+    g_free (value);
+}
 
+static void
+blpm_polkit_free_data (XfpmPolkit *polkit)
+{
     g_assert (polkit->priv->subject_valid);
 
     XFPM_DEBUG ("Destroying Polkit data");
@@ -261,16 +290,19 @@ blpm_polkit_free_data (gpointer data)
     polkit->priv->subject_hash = NULL;
     polkit->priv->subject      = NULL;
 
-    polkit->priv->destroy_id = 0;
     polkit->priv->subject_valid = FALSE;
-    
-    return FALSE;
 }
 
+/*
+ * The subject is our own process, whose pid and start time never change,
+ * so it is built on the first check and kept until we exit.
+ */
 static void
 blpm_polkit_init_data (XfpmPolkit *polkit)
 {
     GValue hash_elem = { 0 };
+    GValue val = { 0 };
+    GValue *pid_val, *start_time_val;
     gint pid;
     guint64 start_time;
 
@@ -281,42 +313,41 @@ blpm_polkit_init_data (XfpmPolkit *polkit)
 
     start_time = get_start_time_for_pid (pid);
 
-    if ( G_LIKELY (start_time != 0 ) )
+    if ( G_UNLIKELY (start_time == 0 ) )
     {
-	GValue val = { 0 }, pid_val = { 0 }, start_time_val = { 0 };
+	g_warning ("Unable to create polkit subject");
+	return;
+    }
 
-	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-	polkit->priv->subject = g_value_array_new (2);
-	G_GNUC_END_IGNORE_DEPRECATIONS
-	polkit->priv->subject_hash = g_hash_table_new_full (g_str_hash,
-							    g_str_equal,
-							    g_free,
-							    NULL);
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    polkit->priv->subject = g_value_array_new (2);
+    G_GNUC_END_IGNORE_DEPRECATIONS
+    polkit->priv->subject_hash = g_hash_table_new_full (g_str_hash,
+							g_str_equal,
+							g_free,
+							blpm_polkit_free_value);
 
-	g_value_init (&val, G_TYPE_STRING);
-	g_value_set_string (&val, "unix-process");
-	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
-	g_value_array_append (polkit->priv->subject, &val);
-	G_GNUC_END_IGNORE_DEPRECATIONS
+    g_value_init (&val, G_TYPE_STRING);
+    g_value_set_static_string (&val, "unix-process");
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    g_value_array_append (polkit->priv->subject, &val);
+    G_GNUC_END_IGNORE_DEPRECATIONS
 
-	g_value_unset (&val);
+    g_value_unset (&val);
 
-	g_value_init (&pid_val, G_TYPE_UINT);
-	g_value_set_uint (&pid_val, pid);
-	g_hash_table_insert (polkit->priv->subject_hash,
-			     g_strdup ("pid"), &pid_val);
+    pid_val = g_new0 (GValue, 1);
+    g_value_init (pid_val, G_TYPE_UINT);
+    g_value_set_uint (pid_val, pid);
+    g_hash_table_insert (polkit->priv->subject_hash,
+			 g_strdup ("pid"), pid_val);
 
-	g_value_init (&start_time_val, G_TYPE_UINT64);
-	g_value_set_uint64 (&start_time_val, start_time);
-	g_hash_table_insert (polkit->priv->subject_hash,
-			     g_strdup ("start-time"), &start_time_val);
+    start_time_val = g_new0 (GValue, 1);
+    g_value_init (start_time_val, G_TYPE_UINT64);
+    g_value_set_uint64 (start_time_val, start_time);
+    g_hash_table_insert (polkit->priv->subject_hash,
+			 g_strdup ("start-time"), start_time_val);
 
-	XFPM_DEBUG ("Using unix session polkit subject");
-    }
-    else
-    {
-	g_warning ("Unable to create polkit subject");
-    }
+    XFPM_DEBUG ("Using unix session polkit subject");
 
     g_value_init (&hash_elem, 
 		  dbus_g_type_get_map ("GHashTable", 
@@ -327,6 +358,7 @@ blpm_polkit_init_data (XfpmPolkit *polkit)
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS
     g_value_array_append (polkit->priv->subject, &hash_elem);
     G_GNUC_END_IGNORE_DEPRECATIONS
+    g_value_unset (&hash_elem);
     
     /**
      * Polkit details, will leave it empty.
@@ -336,23 +368,50 @@ blpm_polkit_init_data (XfpmPolkit *polkit)
 						   g_free, 
 						   g_free);
     
-    /*Clean these data after 1 minute*/
-    polkit->priv->destroy_id = 
-	g_timeout_add_seconds (60, (GSourceFunc) blpm_polkit_free_data, polkit);
-    
     polkit->priv->subject_valid = TRUE;
 }
 #endif /*ENABLE_POLKIT*/
 
+#ifdef ENABLE_POLKIT
+static gboolean
+blpm_polkit_parse_result (XfpmPolkit *polkit, GValueArray *result)
+{
+    GValue result_val = { 0 };
+    gboolean is_authorized = FALSE;
+
+    g_value_init (&result_val, polkit->priv->result_gtype);
+    g_value_set_static_boxed (&result_val, result);
+
+    dbus_g_type_struct_get (&result_val,
+			    0, &is_authorized,
+			    G_MAXUINT);
+    g_value_unset (&result_val);
+
+    return is_authorized;
+}
+
+static void
+blpm_polkit_cache_set (XfpmPolkit *polkit, const gchar *action_id, XfpmPolkitAuthState state)
+{
+    g_hash_table_insert (polkit->priv->cache, g_strdup (action_id), GINT_TO_POINTER (state));
+}
+
+static XfpmPolkitAuthState
+blpm_polkit_cache_get (XfpmPolkit *polkit, const gchar *action_id)
+{
+    return GPOINTER_TO_INT (g_hash_table_lookup (polkit->priv->cache, action_id));
+}
+#endif /*ENABLE_POLKIT*/
+
 static gboolean
 blpm_polkit_check_auth_intern (XfpmPolkit *polkit, const gchar *action_id)
 {
 #ifdef ENABLE_POLKIT
     GValueArray *result;
-    GValue result_val = { 0 };
     GError *error = NULL;
     gboolean is_authorized = FALSE;
     gboolean ret;
+    XfpmPolkitAuthState state;
     
     /**
      * <method name="CheckAuthorization">      
@@ -368,11 +427,16 @@ blpm_polkit_check_auth_intern (XfpmPolkit *polkit, const gchar *action_id)
     
     g_return_val_if_fail (polkit->priv->proxy != NULL, FALSE);
     g_return_val_if_fail (polkit->priv->subject_valid, FALSE);
+
+    state = blpm_polkit_cache_get (polkit, action_id);
+    if ( state == XFPM_POLKIT_AUTH_YES || state == XFPM_POLKIT_AUTH_NO )
+	return state == XFPM_POLKIT_AUTH_YES;
     
     G_GNUC_BEGIN_IGNORE_DEPRECATIONS
     result = g_value_array_new (0);
     G_GNUC_END_IGNORE_DEPRECATIONS
     
+    blpm_startup_count_dbus_call ();
     ret = dbus_g_proxy_call (polkit->priv->proxy, "CheckAuthorization", &error,
 			     polkit->priv->subject_gtype, polkit->priv->subject,
 			     G_TYPE_STRING, action_id,
@@ -385,13 +449,9 @@ blpm_polkit_check_auth_intern (XfpmPolkit *polkit, const gchar *action_id)
     
     if ( G_LIKELY (ret) )
     {
-	g_value_init (&result_val, polkit->priv->result_gtype);
-	g_value_set_static_boxed (&result_val, result);
-	
-	dbus_g_type_struct_get (&result_val,
-				0, &is_authorized,
-				G_MAXUINT);
-	g_value_unset (&result_val);
+	is_authorized = blpm_polkit_parse_result (polkit, result);
+	blpm_polkit_cache_set (polkit, action_id,
+			       is_authorized ? XFPM_POLKIT_AUTH_YES : XFPM_POLKIT_AUTH_NO);
     }
     else if ( error )
     {
@@ -411,10 +471,66 @@ blpm_polkit_check_auth_intern (XfpmPolkit *polkit, const gchar *action_id)
 }
 
 #ifdef ENABLE_POLKIT
+static void
+blpm_polkit_call_free (XfpmPolkitCall *call)
+{
+    g_free (call->action_id);
+    g_slice_free (XfpmPolkitCall, call);
+}
+
+static void
+blpm_polkit_check_auth_reply (DBusGProxy *proxy, DBusGProxyCall *pcall, gpointer data)
+{
+    XfpmPolkitCall *call = data;
+    XfpmPolkit *polkit = call->polkit;
+    GValueArray *result = NULL;
+    GError *error = NULL;
+    gboolean is_authorized = FALSE;
+    gboolean answered;
+
+    answered = dbus_g_proxy_end_call (proxy, pcall, &error,
+				      polkit->priv->result_gtype, &result,
+				      G_TYPE_INVALID);
+
+    if ( answered )
+    {
+	is_authorized = blpm_polkit_parse_result (polkit, result);
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+	g_value_array_free (result);
+	G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+    else if ( error )
+    {
+	g_warning ("'CheckAuthorization' failed with %s", error->message);
+	g_error_free (error);
+    }
+
+    XFPM_DEBUG ("Action=%s is authorized=%s", call->action_id, blpm_bool_to_string (is_authorized));
+
+    /* the authority changed while we were waiting, a new check is already queued */
+    if ( call->generation != polkit->priv->generation )
+	return;
+
+    /* a failed call (timeout, polkitd restarting) says nothing about the
+     * authorization, forget the pending entry so the next check asks again */
+    if ( answered )
+	blpm_polkit_cache_set (polkit, call->action_id,
+			       is_authorized ? XFPM_POLKIT_AUTH_YES : XFPM_POLKIT_AUTH_NO);
+    else
+	g_hash_table_remove (polkit->priv->cache, call->action_id);
+
+    g_signal_emit (G_OBJECT (polkit), signals [AUTH_RESULT], 0, call->action_id, is_authorized);
+}
+
 static void
 blpm_polkit_changed_cb (DBusGProxy *proxy, XfpmPolkit *polkit)
 {
     XFPM_DEBUG ("Auth changed");
+
+    /* forget everything, replies still in flight are now stale */
+    g_hash_table_remove_all (polkit->priv->cache);
+    polkit->priv->generation++;
+
     g_signal_emit (G_OBJECT (polkit), signals [AUTH_CHANGED], 0);
 }
 #endif
@@ -435,6 +551,15 @@ blpm_polkit_class_init (XfpmPolkitClass *klass)
                       g_cclosure_marshal_VOID__VOID,
                       G_TYPE_NONE, 0, G_TYPE_NONE);
 
+    signals [AUTH_RESULT] = 
+        g_signal_new ("auth-result",
+                      XFPM_TYPE_POLKIT,
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET(XfpmPolkitClass, auth_result),
+                      NULL, NULL,
+                      _blpm_marshal_VOID__STRING_BOOLEAN,
+                      G_TYPE_NONE, 2, G_TYPE_STRING, G_TYPE_BOOLEAN);
+
     g_type_class_add_private (klass, sizeof (XfpmPolkitPrivate));
 }
 
@@ -446,12 +571,13 @@ blpm_polkit_init (XfpmPolkit *polkit)
     polkit->priv = XFPM_POLKIT_GET_PRIVATE (polkit);
 
 #ifdef ENABLE_POLKIT
-    polkit->priv->destroy_id   = 0;
     polkit->priv->subject_valid   = FALSE;
     polkit->priv->proxy        = NULL;
     polkit->priv->subject      = NULL;
     polkit->priv->details      = NULL;
     polkit->priv->subject_hash = NULL;
+    polkit->priv->generation   = 0;
+    polkit->priv->cache        = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     
     polkit->priv->subject_gtype = 
         dbus_g_type_get_struct ("GValueArray", 
@@ -523,11 +649,9 @@ blpm_polkit_finalize (GObject *object)
     }
 
     if ( polkit->priv->subject_valid )
-    {
 	blpm_polkit_free_data (polkit);
-	if (polkit->priv->destroy_id != 0 )
-	    g_source_remove (polkit->priv->destroy_id);
-    }
+
+    g_hash_table_destroy (polkit->priv->cache);
 #endif /*ENABLE_POLKIT*/
 
 
@@ -562,3 +686,61 @@ gboolean blpm_polkit_check_auth	(XfpmPolkit *polkit, const gchar *action_id)
 #endif
     return blpm_polkit_check_auth_intern (polkit, action_id);
 }
+
+/**
+ * blpm_polkit_check_auth_async:
+ *
+ * Starts a CheckAuthorization call without waiting for it, the answer
+ * is delivered by the "auth-result" signal. Checks for different actions
+ * run concurrently, a check already in flight is not issued twice and a
+ * cached answer is emitted right away.
+ **/
+void blpm_polkit_check_auth_async (XfpmPolkit *polkit, const gchar *action_id)
+{
+#ifdef ENABLE_POLKIT
+    XfpmPolkitCall *call;
+    XfpmPolkitAuthState state;
+
+    g_return_if_fail (XFPM_IS_POLKIT (polkit));
+    g_return_if_fail (action_id != NULL);
+
+    state = blpm_polkit_cache_get (polkit, action_id);
+
+    if ( state == XFPM_POLKIT_AUTH_PENDING )
+	return;
+
+    if ( state == XFPM_POLKIT_AUTH_YES || state == XFPM_POLKIT_AUTH_NO )
+    {
+	g_signal_emit (G_OBJECT (polkit), signals [AUTH_RESULT], 0,
+		       action_id, state == XFPM_POLKIT_AUTH_YES);
+	return;
+    }
+
+    blpm_polkit_init_data (polkit);
+
+    if ( polkit->priv->proxy == NULL || !polkit->priv->subject_valid )
+    {
+	g_signal_emit (G_OBJECT (polkit), signals [AUTH_RESULT], 0, action_id, FALSE);
+	return;
+    }
+
+    call = g_slice_new (XfpmPolkitCall);
+    call->polkit = polkit;
+    call->action_id = g_strdup (action_id);
+    call->generation = polkit->priv->generation;
+
+    blpm_polkit_cache_set (polkit, action_id, XFPM_POLKIT_AUTH_PENDING);
+
+    dbus_g_proxy_begin_call (polkit->priv->proxy, "CheckAuthorization",
+			     blpm_polkit_check_auth_reply, call,
+			     (GDestroyNotify) blpm_polkit_call_free,
+			     polkit->priv->subject_gtype, polkit->priv->subject,
+			     G_TYPE_STRING, action_id,
+			     polkit->priv->details_gtype, polkit->priv->details,
+			     G_TYPE_UINT, 0,
+			     G_TYPE_STRING, NULL,
+			     G_TYPE_INVALID);
+#else
+    g_signal_emit (G_OBJECT (polkit), signals [AUTH_RESULT], 0, action_id, TRUE);
+#endif
+}
@@ -43,6 +43,10 @@ typedef struct
     GObjectClass 	   parent_class;
     
     void		  (*auth_changed)		(XfpmPolkit *polkit);
+
+    void		  (*auth_result)		(XfpmPolkit *polkit,
+							 const gchar *action_id,
+							 gboolean is_authorized);
     
 } XfpmPolkitClass;
 
@@ -53,6 +57,9 @@ XfpmPolkit                *blpm_polkit_get             	(void);
 gboolean		   blpm_polkit_check_auth	(XfpmPolkit *polkit,
 							 const gchar *action_id);
 
+void			   blpm_polkit_check_auth_async	(XfpmPolkit *polkit,
+							 const gchar *action_id);
+
 G_END_DECLS
 
 #endif /* __XFPM_POLKIT_H */
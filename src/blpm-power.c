@@ -52,6 +52,7 @@
 #include "blpm-inhibit.h"
 #include "blpm-polkit.h"
 #include "blpm-network-manager.h"
+#include "blpm-screen-locker.h"
 #include "blpm-icons.h"
 #include "blpm-common.h"
 #include "blpm-power-common.h"
@@ -61,7 +62,7 @@
 #include "egg-idletime.h"
 #include "blpm-systemd.h"
 #include "blpm-suspend.h"
-#include "blpm-brightness.h"
+#include "blpm-resume-state.h"
 
 static void blpm_power_finalize     (GObject *object);
 
@@ -87,6 +88,116 @@ static void blpm_power_dbus_init (XfpmPower *power);
 #define XFPM_POWER_GET_PRIVATE(o) \
 (G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_POWER, XfpmPowerPrivate))
 
+/*
+ * Work done before going to sleep. The stages are all started at once,
+ * the backend is called when each of them completed or ran out of time.
+ */
+typedef enum
+{
+    XFPM_SLEEP_STAGE_SNAPSHOT,
+    XFPM_SLEEP_STAGE_NETWORK,
+    XFPM_SLEEP_STAGE_LOCK,
+    XFPM_SLEEP_STAGE_N
+} XfpmSleepStage;
+
+#define XFPM_SLEEP_STAGE_BIT(stage) (1 << (stage))
+
+/* Deadlines in ms, after which a stage is considered done anyway */
+static const guint blpm_sleep_stage_deadlines [XFPM_SLEEP_STAGE_N] =
+{
+    1000, /* XFPM_SLEEP_STAGE_SNAPSHOT */
+    2000, /* XFPM_SLEEP_STAGE_NETWORK */
+    3000  /* XFPM_SLEEP_STAGE_LOCK */
+};
+
+/*
+ * Points in a sleep cycle we keep the time of. The stage marks are in
+ * the same order as XfpmSleepStage and are taken when the stage is done.
+ */
+typedef enum
+{
+    XFPM_SLEEP_MARK_SLEEPING,
+    XFPM_SLEEP_MARK_SNAPSHOT,
+    XFPM_SLEEP_MARK_NETWORK,
+    XFPM_SLEEP_MARK_LOCK,
+    XFPM_SLEEP_MARK_BACKEND_START,
+    XFPM_SLEEP_MARK_BACKEND_RETURN,
+    XFPM_SLEEP_MARK_WAKING_UP,
+    XFPM_SLEEP_MARK_PROPERTIES,
+    XFPM_SLEEP_MARK_RESTORE,
+    XFPM_SLEEP_MARK_N
+} XfpmSleepMark;
+
+static const gchar *blpm_sleep_mark_names [XFPM_SLEEP_MARK_N] =
+{
+    "sleeping",
+    "snapshot",
+    "network",
+    "lock",
+    "backend-start",
+    "backend-return",
+    "waking-up",
+    "properties",
+    "restore"
+};
+
+/*
+ * State published over D-Bus, the names are those of the methods
+ * clients would otherwise poll.
+ */
+typedef enum
+{
+    XFPM_POWER_STATE_ON_BATTERY,
+    XFPM_POWER_STATE_LOW_BATTERY,
+    XFPM_POWER_STATE_CAN_SUSPEND,
+    XFPM_POWER_STATE_CAN_HIBERNATE,
+    XFPM_POWER_STATE_AUTH_SUSPEND,
+    XFPM_POWER_STATE_AUTH_HIBERNATE,
+    XFPM_POWER_STATE_CAN_SHUTDOWN,
+    XFPM_POWER_STATE_CAN_REBOOT,
+    XFPM_POWER_STATE_N
+} XfpmPowerState;
+
+static const gchar *blpm_power_state_names [XFPM_POWER_STATE_N] =
+{
+    "OnBattery",
+    "LowBattery",
+    "CanSuspend",
+    "CanHibernate",
+    "AuthSuspend",
+    "AuthHibernate",
+    "CanShutdown",
+    "CanReboot"
+};
+
+/* Number of sleep cycles kept */
+#define XFPM_SLEEP_TIMINGS 8
+
+typedef struct
+{
+    gint64           started;	/* wall clock, to line up with the kernel log */
+    gboolean         hibernate;
+    gint64           marks [XFPM_SLEEP_MARK_N];	/* monotonic, 0 if not reached */
+    gboolean         timed_out [XFPM_SLEEP_STAGE_N];	/* ended by its deadline */
+} XfpmSleepTiming;
+
+typedef struct
+{
+    XfpmPower       *power;
+    gchar           *sleep_time;
+    XfpmSleepTiming *timing;
+
+    guint            pending;
+    guint            deadline_id [XFPM_SLEEP_STAGE_N];
+    guint            backend_id;
+
+    gboolean         network_manager_sleep;
+    gboolean         lock_failed;
+
+    /* D-Bus callers waiting for the resume */
+    GSList          *contexts;
+} XfpmPowerSleep;
+
 struct XfpmPowerPrivate
 {
     DBusGConnection *bus;
@@ -98,6 +209,8 @@ struct XfpmPowerPrivate
 
     XfpmSystemd     *systemd;
     XfpmConsoleKit  *console;
+    XfpmNetworkManager *network_manager;
+    XfpmScreenLocker *screen_locker;
     XfpmInhibit	    *inhibit;
     XfpmBlconf      *conf;
 
@@ -112,9 +225,26 @@ struct XfpmPowerPrivate
 
     gboolean	     inhibited;
 
+    /* Sleep in progress, if any */
+    XfpmPowerSleep  *sleep_request;
+    XfpmResumeState *resume_state;
+    /* time from the backend returning to the session being usable, in ms */
+    gdouble          resume_latency;
+
+    /* What clients were last told about, see blpm_power_queue_state_changed */
+    gboolean         published_state [XFPM_POWER_STATE_N];
+    guint            state_changed_id;
+
+    /* The last sleep cycles, oldest overwritten first */
+    XfpmSleepTiming  sleep_timings [XFPM_SLEEP_TIMINGS];
+    guint            sleep_timings_next;
+    guint            sleep_timings_len;
+
     XfpmNotify	    *notify;
 #ifdef ENABLE_POLKIT
     XfpmPolkit 	    *polkit;
+    const gchar     *auth_suspend_action;
+    const gchar     *auth_hibernate_action;
 #endif
     gboolean	     auth_suspend;
     gboolean	     auth_hibernate;
@@ -160,6 +290,7 @@ enum
     SLEEPING,
     ASK_SHUTDOWN,
     SHUTDOWN,
+    STATE_CHANGED,
     LAST_SIGNAL
 };
 
@@ -240,14 +371,111 @@ blpm_power_check_polkit_auth (XfpmPower *power)
 	}
 #endif
     }
-    power->priv->auth_suspend = blpm_polkit_check_auth (power->priv->polkit,
-							suspend);
+    power->priv->auth_suspend_action   = suspend;
+    power->priv->auth_hibernate_action = hibernate;
+
+    /* answers come back through blpm_power_polkit_auth_result_cb */
+    if ( suspend != NULL )
+	blpm_polkit_check_auth_async (power->priv->polkit, suspend);
 
-    power->priv->auth_hibernate = blpm_polkit_check_auth (power->priv->polkit,
-							  hibernate);
+    if ( hibernate != NULL )
+	blpm_polkit_check_auth_async (power->priv->polkit, hibernate);
 }
 #endif
 
+static void
+blpm_power_read_state (XfpmPower *power, gboolean state [XFPM_POWER_STATE_N])
+{
+    GObject *session = LOGIND_RUNNING () ? G_OBJECT (power->priv->systemd) : G_OBJECT (power->priv->console);
+    gboolean can_shutdown = FALSE, can_reboot = FALSE;
+
+    if ( session != NULL )
+	g_object_get (session,
+		      "can-shutdown", &can_shutdown,
+		      "can-restart", &can_reboot,
+		      NULL);
+
+    state [XFPM_POWER_STATE_ON_BATTERY]     = power->priv->on_battery;
+    state [XFPM_POWER_STATE_LOW_BATTERY]    = power->priv->on_low_battery;
+    state [XFPM_POWER_STATE_CAN_SUSPEND]    = power->priv->can_suspend;
+    state [XFPM_POWER_STATE_CAN_HIBERNATE]  = power->priv->can_hibernate;
+    state [XFPM_POWER_STATE_AUTH_SUSPEND]   = power->priv->auth_suspend;
+    state [XFPM_POWER_STATE_AUTH_HIBERNATE] = power->priv->auth_hibernate;
+    state [XFPM_POWER_STATE_CAN_SHUTDOWN]   = can_shutdown;
+    state [XFPM_POWER_STATE_CAN_REBOOT]     = can_reboot;
+}
+
+static void
+blpm_power_state_value_free (GValue *value)
+{
+    g_value_unset (value);
+    g_free (value);
+}
+
+static void
+blpm_power_state_insert (GHashTable *hash, XfpmPowerState field, gboolean value)
+{
+    GValue *gvalue;
+
+    gvalue = g_new0 (GValue, 1);
+    g_value_init (gvalue, G_TYPE_BOOLEAN);
+    g_value_set_boolean (gvalue, value);
+
+    g_hash_table_insert (hash, (gpointer) blpm_power_state_names [field], gvalue);
+}
+
+static GHashTable *
+blpm_power_state_hash_new (void)
+{
+    return g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+				  (GDestroyNotify) blpm_power_state_value_free);
+}
+
+static gboolean
+blpm_power_state_changed_idle (gpointer data)
+{
+    XfpmPower *power = data;
+    gboolean state [XFPM_POWER_STATE_N];
+    GHashTable *changed;
+    gint i;
+
+    power->priv->state_changed_id = 0;
+
+    blpm_power_read_state (power, state);
+
+    changed = blpm_power_state_hash_new ();
+    for ( i = 0; i < XFPM_POWER_STATE_N; i++ )
+    {
+	if ( state [i] != power->priv->published_state [i] )
+	{
+	    blpm_power_state_insert (changed, i, state [i]);
+	    power->priv->published_state [i] = state [i];
+	}
+    }
+
+    if ( g_hash_table_size (changed) > 0 )
+    {
+	XFPM_DEBUG ("%u state fields changed", g_hash_table_size (changed));
+	g_signal_emit (G_OBJECT (power), signals [STATE_CHANGED], 0, changed);
+    }
+
+    g_hash_table_destroy (changed);
+
+    return FALSE;
+}
+
+/*
+ * Called wherever something clients see may have changed. The fields
+ * are compared against what was published once the main loop is idle,
+ * so a burst of changes goes out as one state-changed.
+ */
+static void
+blpm_power_queue_state_changed (XfpmPower *power)
+{
+    if ( power->priv->state_changed_id == 0 )
+	power->priv->state_changed_id = g_idle_add (blpm_power_state_changed_idle, power);
+}
+
 static void
 blpm_power_check_power (XfpmPower *power, gboolean on_battery)
 {
@@ -258,6 +486,7 @@ blpm_power_check_power (XfpmPower *power, gboolean on_battery)
 	    g_signal_emit (G_OBJECT (power), signals [ON_BATTERY_CHANGED], 0, on_battery);
 
         blpm_dpms_set_on_battery (power->priv->dpms, on_battery);
+        blpm_power_queue_state_changed (power);
 
 	    power->priv->on_battery = on_battery;
 	    list = g_hash_table_get_values (power->priv->hash);
@@ -329,7 +558,9 @@ blpm_power_get_properties (XfpmPower *power)
 			  "can-hibernate", &power->priv->can_hibernate,
 			  NULL);
 	}
-	else
+	/* don't probe pm-utils while ConsoleKit may still answer, "info-ready" settles it */
+	else if ( power->priv->console == NULL ||
+		  !blpm_console_kit_info_pending (power->priv->console) )
 	{
 	    power->priv->can_suspend   = blpm_suspend_can_suspend ();
 	    power->priv->can_hibernate = blpm_suspend_can_hibernate ();
@@ -343,7 +574,72 @@ blpm_power_get_properties (XfpmPower *power)
                   NULL);
     blpm_power_check_lid (power, lid_is_present, lid_is_closed);
     blpm_power_check_power (power, on_battery);
+    blpm_power_queue_state_changed (power);
+}
+
+#if UP_CHECK_VERSION(0, 99, 0)
+static void
+blpm_power_set_sleep_caps (XfpmPower *power, gboolean can_suspend, gboolean can_hibernate)
+{
+    if ( power->priv->can_suspend != can_suspend )
+    {
+	power->priv->can_suspend = can_suspend;
+	g_object_notify (G_OBJECT (power), "can-suspend");
+    }
+
+    if ( power->priv->can_hibernate != can_hibernate )
+    {
+	power->priv->can_hibernate = can_hibernate;
+	g_object_notify (G_OBJECT (power), "can-hibernate");
+    }
+
+    blpm_power_queue_state_changed (power);
+}
+
+static void
+blpm_power_systemd_can_changed_cb (XfpmPower *power)
+{
+    gboolean can_suspend, can_hibernate;
+
+    g_object_get (G_OBJECT (power->priv->systemd),
+		  "can-suspend", &can_suspend,
+		  "can-hibernate", &can_hibernate,
+		  NULL);
+
+    blpm_power_set_sleep_caps (power, can_suspend, can_hibernate);
+}
+
+/*
+ * ConsoleKit answers its capability queries asynchronously, and again
+ * whenever it is restarted or goes away, so the backend choice is
+ * revisited here once all the answers are in.
+ */
+static void
+blpm_power_console_info_ready_cb (XfpmPower *power)
+{
+    gboolean can_suspend, can_hibernate;
+
+    if ( check_for_consolekit2 (power) )
+    {
+	g_object_get (G_OBJECT (power->priv->console),
+		      "can-suspend", &can_suspend,
+		      "can-hibernate", &can_hibernate,
+		      NULL);
+    }
+    else
+    {
+	can_suspend   = blpm_suspend_can_suspend ();
+	can_hibernate = blpm_suspend_can_hibernate ();
+    }
+
+    blpm_power_set_sleep_caps (power, can_suspend, can_hibernate);
+
+#ifdef ENABLE_POLKIT
+    if ( power->priv->polkit != NULL )
+	blpm_power_check_polkit_auth (power);
+#endif
 }
+#endif
 
 static void
 blpm_power_report_error (XfpmPower *power, const gchar *error, const gchar *icon_name)
@@ -377,75 +673,109 @@ blpm_power_report_error (XfpmPower *power, const gchar *error, const gchar *icon
 }
 
 static void
-blpm_power_sleep (XfpmPower *power, const gchar *sleep_time, gboolean force)
+blpm_power_sleep_mark (XfpmPowerSleep *request, XfpmSleepMark mark)
 {
-    GError *error = NULL;
-    gboolean lock_screen;
-#ifdef WITH_NETWORK_MANAGER
-    gboolean network_manager_sleep;
-#endif
-    XfpmBrightness *brightness;
-    gint32 brightness_level;
+    request->timing->marks [mark] = g_get_monotonic_time ();
+}
 
-    if ( power->priv->inhibited && force == FALSE)
+static void
+blpm_power_sleep_free (XfpmPowerSleep *request, const GError *error)
+{
+    GSList *li;
+    gint i;
+
+    for ( i = 0; i < XFPM_SLEEP_STAGE_N; i++ )
     {
-	gboolean ret;
+	if ( request->deadline_id [i] != 0 )
+	    g_source_remove (request->deadline_id [i]);
+    }
 
-	ret = xfce_dialog_confirm (NULL,
-				   GTK_STOCK_OK, _("_Hibernate"),
-				   _("An application is currently disabling the automatic sleep. "
-				     "Doing this action now may damage the working state of this application."),
-				   _("Are you sure you want to hibernate the system?"));
+    if ( request->backend_id != 0 )
+	g_source_remove (request->backend_id);
 
-	if ( !ret )
-	    return;
+    for ( li = request->contexts; li != NULL; li = li->next )
+    {
+	if ( error )
+	    dbus_g_method_return_error (li->data, (GError *) error);
+	else
+	    dbus_g_method_return (li->data);
     }
+    g_slist_free (request->contexts);
 
-    g_signal_emit (G_OBJECT (power), signals [SLEEPING], 0);
-    /* Get the current brightness level so we can use it after we suspend */
-    brightness = blpm_brightness_new();
-    blpm_brightness_setup (brightness);
-    blpm_brightness_get_level (brightness, &brightness_level);
+    g_free (request->sleep_time);
+    g_free (request);
+}
 
-#ifdef WITH_NETWORK_MANAGER
-    g_object_get (G_OBJECT (power->priv->conf),
-                  NETWORK_MANAGER_SLEEP, &network_manager_sleep,
-                  NULL);
+/*
+ * Everything that has to happen once we are back, or once the
+ * sleep was called off after the stages had already started.
+ */
+static void
+blpm_power_sleep_finish (XfpmPowerSleep *request, const GError *error)
+{
+    XfpmPower *power = request->power;
+
+    power->priv->sleep_request = NULL;
 
-    if ( network_manager_sleep )
+    g_signal_emit (G_OBJECT (power), signals [WAKING_UP], 0);
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_WAKING_UP);
+    /* Check/update any changes while we slept */
+    blpm_power_get_properties (power);
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_PROPERTIES);
+    /* Put back brightness, dpms and the like from before we suspended */
+    blpm_resume_state_restore (power->priv->resume_state);
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_RESTORE);
+
+    if ( request->timing->marks [XFPM_SLEEP_MARK_BACKEND_RETURN] != 0 )
+    {
+	power->priv->resume_latency = (request->timing->marks [XFPM_SLEEP_MARK_RESTORE] -
+				       request->timing->marks [XFPM_SLEEP_MARK_BACKEND_RETURN]) / 1000.0;
+	XFPM_DEBUG ("Resume took %.1f ms", power->priv->resume_latency);
+    }
+
+#ifdef WITH_NETWORK_MANAGER
+    if ( request->network_manager_sleep )
     {
-        blpm_network_manager_sleep (TRUE);
+        blpm_network_manager_sleep (power->priv->network_manager, FALSE);
     }
 #endif
 
-    g_object_get (G_OBJECT (power->priv->conf),
-		  LOCK_SCREEN_ON_SLEEP, &lock_screen,
-		  NULL);
+    blpm_power_sleep_free (request, error);
+}
 
-    if ( lock_screen )
+static gboolean
+blpm_power_sleep_backend (gpointer data)
+{
+    XfpmPowerSleep *request = data;
+    XfpmPower *power = request->power;
+    const gchar *sleep_time = request->sleep_time;
+    GError *error = NULL;
+
+    request->backend_id = 0;
+
+    if ( request->lock_failed )
     {
-#ifdef WITH_NETWORK_MANAGER
-        if ( network_manager_sleep )
-        {
-	    /* 2 seconds, to give network manager time to sleep */
-            g_usleep (2000000);
+	gboolean ret;
+
+	ret = xfce_dialog_confirm (NULL,
+				   GTK_STOCK_OK, _("Continue"),
+				   request->timing->timed_out [XFPM_SLEEP_STAGE_LOCK] ?
+				   _("The screen locker did not answer in time, "
+				     "the screen may not be locked.") :
+				   _("None of the screen lock tools ran "
+				     "successfully, the screen will not "
+				     "be locked."),
+				   _("Do you still want to continue to "
+				     "suspend the system?"));
+
+	if ( !ret )
+	{
+	    g_set_error (&error, XFPM_ERROR, XFPM_ERROR_SLEEP_FAILED,
+			 _("Cancelled by the user"));
+	    blpm_power_sleep_finish (request, error);
+	    g_error_free (error);
+	    return FALSE;
 	}
-#endif
-        if (!blpm_lock_screen ())
-        {
-	    gboolean ret;
-
-	    ret = xfce_dialog_confirm (NULL,
-				       GTK_STOCK_OK, _("Continue"),
-			               _("None of the screen lock tools ran "
-				         "successfully, the screen will not "
-					 "be locked."),
-				       _("Do you still want to continue to "
-				         "suspend the system?"));
-
-	    if ( !ret )
-		return;
-        }
     }
 
     /* This is fun, here's the order of operations:
@@ -454,6 +784,8 @@ blpm_power_sleep (XfpmPower *power, const gchar *sleep_time, gboolean force)
      * - if ConsoleKit2 is running then use it
      * - if everything else fails use our built-in fallback
      */
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_BACKEND_START);
+
     if ( LOGIND_RUNNING () )
     {
 	blpm_systemd_sleep (power->priv->systemd, sleep_time, &error);
@@ -495,31 +827,241 @@ blpm_power_sleep (XfpmPower *power, const gchar *sleep_time, gboolean force)
 #endif
     }
 
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_BACKEND_RETURN);
+
     if ( error )
     {
 	if ( g_error_matches (error, DBUS_GERROR, DBUS_GERROR_NO_REPLY) )
 	{
 	    XFPM_DEBUG ("D-Bus time out, but should be harmless");
+	    g_error_free (error);
+	    error = NULL;
 	}
 	else
 	{
 	    blpm_power_report_error (power, error->message, "dialog-error");
-	    g_error_free (error);
 	}
     }
 
-    g_signal_emit (G_OBJECT (power), signals [WAKING_UP], 0);
-    /* Check/update any changes while we slept */
-    blpm_power_get_properties (power);
-    /* Restore the brightness level from before we suspended */
-    blpm_brightness_set_level (brightness, brightness_level);
+    blpm_power_sleep_finish (request, error);
 
-#ifdef WITH_NETWORK_MANAGER
-    if ( network_manager_sleep )
+    if ( error )
+	g_error_free (error);
+
+    return FALSE;
+}
+
+static void
+blpm_power_sleep_stage_done (XfpmPowerSleep *request, XfpmSleepStage stage)
+{
+    if ( (request->pending & XFPM_SLEEP_STAGE_BIT (stage)) == 0 )
+	return;
+
+    request->pending &= ~XFPM_SLEEP_STAGE_BIT (stage);
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_SNAPSHOT + stage);
+
+    if ( request->deadline_id [stage] != 0 )
     {
-        blpm_network_manager_sleep (FALSE);
+	g_source_remove (request->deadline_id [stage]);
+	request->deadline_id [stage] = 0;
     }
+
+    XFPM_DEBUG ("Sleep stage %d done, pending 0x%x", stage, request->pending);
+
+    /* Let the main loop breathe (the locker has to draw) before
+     * handing over to the backend */
+    if ( request->pending == 0 && request->backend_id == 0 )
+	request->backend_id = g_idle_add (blpm_power_sleep_backend, request);
+}
+
+typedef struct
+{
+    XfpmPowerSleep *request;
+    XfpmSleepStage  stage;
+} XfpmSleepDeadline;
+
+static gboolean
+blpm_power_sleep_deadline_cb (gpointer data)
+{
+    XfpmSleepDeadline *deadline = data;
+
+    XFPM_DEBUG ("Sleep stage %d hit its deadline", deadline->stage);
+
+    deadline->request->deadline_id [deadline->stage] = 0;
+    deadline->request->timing->timed_out [deadline->stage] = TRUE;
+
+    /* a locker that is still not up can't be counted as locked */
+    if ( deadline->stage == XFPM_SLEEP_STAGE_LOCK )
+	deadline->request->lock_failed = TRUE;
+    blpm_power_sleep_stage_done (deadline->request, deadline->stage);
+
+    return FALSE;
+}
+
+static void
+blpm_power_sleep_stage_begin (XfpmPowerSleep *request, XfpmSleepStage stage)
+{
+    XfpmSleepDeadline *deadline;
+
+    deadline = g_new0 (XfpmSleepDeadline, 1);
+    deadline->request = request;
+    deadline->stage = stage;
+
+    request->pending |= XFPM_SLEEP_STAGE_BIT (stage);
+    request->deadline_id [stage] = g_timeout_add_full (G_PRIORITY_DEFAULT,
+						     blpm_sleep_stage_deadlines [stage],
+						     blpm_power_sleep_deadline_cb,
+						     deadline, g_free);
+}
+
+static void
+blpm_power_sleep_snapshot (XfpmPowerSleep *request)
+{
+    XfpmPower *power = request->power;
+
+    /* Read what we need to put back after we suspend from the live objects */
+    blpm_resume_state_capture (power->priv->resume_state);
+
+    blpm_power_sleep_stage_done (request, XFPM_SLEEP_STAGE_SNAPSHOT);
+}
+
+static void
+blpm_power_sleep_network (XfpmPowerSleep *request)
+{
+#ifdef WITH_NETWORK_MANAGER
+    g_object_get (G_OBJECT (request->power->priv->conf),
+                  NETWORK_MANAGER_SLEEP, &request->network_manager_sleep,
+                  NULL);
+
+    /* Wait for NetworkManager to report it is asleep, the stage
+     * deadline covers it never doing so */
+    if ( request->network_manager_sleep &&
+	 blpm_network_manager_sleep (request->power->priv->network_manager, TRUE) )
+	return;
 #endif
+
+    blpm_power_sleep_stage_done (request, XFPM_SLEEP_STAGE_NETWORK);
+}
+
+static void
+blpm_power_network_manager_sleep_finished_cb (XfpmPower *power)
+{
+    if ( power->priv->sleep_request != NULL )
+	blpm_power_sleep_stage_done (power->priv->sleep_request, XFPM_SLEEP_STAGE_NETWORK);
+}
+
+static void
+blpm_power_sleep_lock (XfpmPowerSleep *request)
+{
+    gboolean lock_screen;
+
+    g_object_get (G_OBJECT (request->power->priv->conf),
+		  LOCK_SCREEN_ON_SLEEP, &lock_screen,
+		  NULL);
+
+    /* Finished by the locker once it is up, or by the stage deadline */
+    if ( lock_screen )
+    {
+	blpm_screen_locker_lock (request->power->priv->screen_locker);
+	return;
+    }
+
+    blpm_power_sleep_stage_done (request, XFPM_SLEEP_STAGE_LOCK);
+}
+
+static void
+blpm_power_screen_locker_lock_finished_cb (XfpmScreenLocker *locker, gboolean locked,
+					   gboolean timed_out, XfpmPower *power)
+{
+    XfpmPowerSleep *request = power->priv->sleep_request;
+
+    if ( request == NULL || (request->pending & XFPM_SLEEP_STAGE_BIT (XFPM_SLEEP_STAGE_LOCK)) == 0 )
+	return;
+
+    if ( !locked )
+	request->lock_failed = TRUE;
+
+    blpm_power_sleep_stage_done (request, XFPM_SLEEP_STAGE_LOCK);
+}
+
+/*
+ * Starts a sleep and returns straight away. If context is not NULL it
+ * is answered once the system is back, or with an error if the sleep
+ * didn't happen.
+ */
+static void
+blpm_power_sleep_async (XfpmPower *power, const gchar *sleep_time, gboolean force,
+			DBusGMethodInvocation *context)
+{
+    XfpmPowerSleep *request;
+
+    if ( power->priv->sleep_request != NULL )
+    {
+	XFPM_DEBUG ("Already going to sleep, joining the running request");
+	if ( context )
+	    power->priv->sleep_request->contexts = g_slist_prepend (power->priv->sleep_request->contexts, context);
+	return;
+    }
+
+    if ( power->priv->inhibited && force == FALSE)
+    {
+	gboolean ret;
+
+	ret = xfce_dialog_confirm (NULL,
+				   GTK_STOCK_OK, _("_Hibernate"),
+				   _("An application is currently disabling the automatic sleep. "
+				     "Doing this action now may damage the working state of this application."),
+				   _("Are you sure you want to hibernate the system?"));
+
+	if ( !ret )
+	{
+	    if ( context )
+	    {
+		GError *error = NULL;
+
+		g_set_error (&error, XFPM_ERROR, XFPM_ERROR_SLEEP_FAILED,
+			     _("Cancelled by the user"));
+		dbus_g_method_return_error (context, error);
+		g_error_free (error);
+	    }
+	    return;
+	}
+    }
+
+    request = g_new0 (XfpmPowerSleep, 1);
+    request->power = power;
+    request->sleep_time = g_strdup (sleep_time);
+    if ( context )
+	request->contexts = g_slist_prepend (NULL, context);
+
+    /* take the oldest slot of the ring for this cycle */
+    request->timing = &power->priv->sleep_timings [power->priv->sleep_timings_next];
+    power->priv->sleep_timings_next = (power->priv->sleep_timings_next + 1) % XFPM_SLEEP_TIMINGS;
+    power->priv->sleep_timings_len = MIN (power->priv->sleep_timings_len + 1, XFPM_SLEEP_TIMINGS);
+    memset (request->timing, 0, sizeof (XfpmSleepTiming));
+    request->timing->started = g_get_real_time ();
+    request->timing->hibernate = !g_strcmp0 (sleep_time, "Hibernate");
+
+    power->priv->sleep_request = request;
+
+    g_signal_emit (G_OBJECT (power), signals [SLEEPING], 0);
+    blpm_power_sleep_mark (request, XFPM_SLEEP_MARK_SLEEPING);
+
+    /* Arm every stage first so none of them can complete the pipeline
+     * while the others are still being started */
+    blpm_power_sleep_stage_begin (request, XFPM_SLEEP_STAGE_SNAPSHOT);
+    blpm_power_sleep_stage_begin (request, XFPM_SLEEP_STAGE_NETWORK);
+    blpm_power_sleep_stage_begin (request, XFPM_SLEEP_STAGE_LOCK);
+
+    blpm_power_sleep_lock (request);
+    blpm_power_sleep_network (request);
+    blpm_power_sleep_snapshot (request);
+}
+
+static void
+blpm_power_sleep (XfpmPower *power, const gchar *sleep_time, gboolean force)
+{
+    blpm_power_sleep_async (power, sleep_time, force, NULL);
 }
 
 static void
@@ -838,6 +1380,7 @@ blpm_power_battery_charge_changed_cb (XfpmBattery *battery, XfpmPower *power)
 
 	power->priv->on_low_battery = TRUE;
 	g_signal_emit (G_OBJECT (power), signals [LOW_BATTERY_CHANGED], 0, power->priv->on_low_battery);
+	blpm_power_queue_state_changed (power);
 	return;
     }
 
@@ -845,6 +1388,7 @@ blpm_power_battery_charge_changed_cb (XfpmBattery *battery, XfpmPower *power)
     {
 	power->priv->on_low_battery = FALSE;
 	g_signal_emit (G_OBJECT (power), signals [LOW_BATTERY_CHANGED], 0, power->priv->on_low_battery);
+	blpm_power_queue_state_changed (power);
     }
 
     g_object_get (G_OBJECT (power->priv->conf),
@@ -942,11 +1486,13 @@ blpm_power_get_power_devices (XfpmPower *power)
 {
 #if !UP_CHECK_VERSION(0, 99, 0)
     /* the device-add callback is called for each device */
+    blpm_startup_count_dbus_call ();
     up_client_enumerate_devices_sync(power->priv->upower, NULL, NULL);
 #else
     GPtrArray *array = NULL;
     guint i;
 
+    blpm_startup_count_dbus_call ();
     array = up_client_get_devices(power->priv->upower);
 
     if ( array )
@@ -1013,6 +1559,27 @@ blpm_power_polkit_auth_changed_cb (XfpmPower *power)
     XFPM_DEBUG ("Auth configuration changed");
     blpm_power_check_polkit_auth (power);
 }
+
+static void
+blpm_power_polkit_auth_result_cb (XfpmPolkit *polkit, const gchar *action_id,
+				  gboolean is_authorized, XfpmPower *power)
+{
+    if ( g_strcmp0 (action_id, power->priv->auth_suspend_action) == 0 &&
+	 power->priv->auth_suspend != is_authorized )
+    {
+	power->priv->auth_suspend = is_authorized;
+	g_object_notify (G_OBJECT (power), "auth-suspend");
+    }
+
+    if ( g_strcmp0 (action_id, power->priv->auth_hibernate_action) == 0 &&
+	 power->priv->auth_hibernate != is_authorized )
+    {
+	power->priv->auth_hibernate = is_authorized;
+	g_object_notify (G_OBJECT (power), "auth-hibernate");
+    }
+
+    blpm_power_queue_state_changed (power);
+}
 #endif
 
 static void
@@ -1088,6 +1655,15 @@ blpm_power_class_init (XfpmPowerClass *klass)
                       g_cclosure_marshal_VOID__VOID,
                       G_TYPE_NONE, 0, G_TYPE_NONE);
 
+    signals [STATE_CHANGED] =
+        g_signal_new ("state-changed",
+                      XFPM_TYPE_POWER,
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET(XfpmPowerClass, state_changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__BOXED,
+                      G_TYPE_NONE, 1, G_TYPE_HASH_TABLE);
+
 #define XFPM_PARAM_FLAGS  (  G_PARAM_READWRITE \
                            | G_PARAM_CONSTRUCT \
                            | G_PARAM_STATIC_NAME \
@@ -1179,6 +1755,8 @@ blpm_power_init (XfpmPower *power)
 {
     GError *error = NULL;
 
+    blpm_startup_phase_begin ("power");
+
     power->priv = XFPM_POWER_GET_PRIVATE (power);
 
     power->priv->hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
@@ -1196,6 +1774,8 @@ blpm_power_init (XfpmPower *power)
     power->priv->critical_action_done = FALSE;
 
     power->priv->dpms                 = blpm_dpms_new ();
+    power->priv->resume_state         = blpm_resume_state_new (power->priv->dpms);
+    power->priv->resume_latency       = -1;
 
     power->priv->presentation_mode    = FALSE;
     power->priv->on_ac_blank          = 15;
@@ -1204,24 +1784,64 @@ blpm_power_init (XfpmPower *power)
     power->priv->inhibit = blpm_inhibit_new ();
     power->priv->notify  = blpm_notify_new ();
     power->priv->conf    = blpm_blconf_new ();
+
+    blpm_startup_phase_begin ("upower-client");
+    blpm_startup_count_dbus_call ();
     power->priv->upower  = up_client_new ();
+    blpm_startup_phase_end ("upower-client");
+
+    power->priv->network_manager = blpm_network_manager_new ();
+    g_signal_connect_swapped (power->priv->network_manager, "sleep-finished",
+                              G_CALLBACK (blpm_power_network_manager_sleep_finished_cb), power);
+
+    power->priv->screen_locker = blpm_screen_locker_new ();
+    g_signal_connect (power->priv->screen_locker, "lock-finished",
+		      G_CALLBACK (blpm_power_screen_locker_lock_finished_cb), power);
 
     power->priv->systemd = NULL;
     power->priv->console = NULL;
     if ( LOGIND_RUNNING () )
+    {
         power->priv->systemd = blpm_systemd_new ();
+#if UP_CHECK_VERSION(0, 99, 0)
+        /* logind answers arrive asynchronously from polkit */
+        g_signal_connect_swapped (power->priv->systemd, "notify::can-suspend",
+                                  G_CALLBACK (blpm_power_systemd_can_changed_cb), power);
+        g_signal_connect_swapped (power->priv->systemd, "notify::can-hibernate",
+                                  G_CALLBACK (blpm_power_systemd_can_changed_cb), power);
+#endif
+        g_signal_connect_swapped (power->priv->systemd, "notify::can-shutdown",
+                                  G_CALLBACK (blpm_power_queue_state_changed), power);
+        g_signal_connect_swapped (power->priv->systemd, "notify::can-restart",
+                                  G_CALLBACK (blpm_power_queue_state_changed), power);
+    }
     else
+    {
 	power->priv->console = blpm_console_kit_new ();
+#if UP_CHECK_VERSION(0, 99, 0)
+        g_signal_connect_swapped (power->priv->console, "info-ready",
+                                  G_CALLBACK (blpm_power_console_info_ready_cb), power);
+#endif
+        g_signal_connect_swapped (power->priv->console, "notify::can-shutdown",
+                                  G_CALLBACK (blpm_power_queue_state_changed), power);
+        g_signal_connect_swapped (power->priv->console, "notify::can-restart",
+                                  G_CALLBACK (blpm_power_queue_state_changed), power);
+    }
 
 #ifdef ENABLE_POLKIT
     power->priv->polkit  = blpm_polkit_get ();
+    power->priv->auth_suspend_action   = NULL;
+    power->priv->auth_hibernate_action = NULL;
     g_signal_connect_swapped (power->priv->polkit, "auth-changed",
 			      G_CALLBACK (blpm_power_polkit_auth_changed_cb), power);
+    g_signal_connect (power->priv->polkit, "auth-result",
+		      G_CALLBACK (blpm_power_polkit_auth_result_cb), power);
 #endif
 
     g_signal_connect (power->priv->inhibit, "has-inhibit-changed",
 		      G_CALLBACK (blpm_power_inhibit_changed_cb), power);
 
+    blpm_startup_count_dbus_call ();
     power->priv->bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
 
     if ( error )
@@ -1238,8 +1858,10 @@ blpm_power_init (XfpmPower *power)
 #else
     g_signal_connect (power->priv->upower, "changed", G_CALLBACK (blpm_power_changed_cb), power);
 #endif
+    blpm_startup_phase_begin ("upower-devices");
     blpm_power_get_power_devices (power);
     blpm_power_get_properties (power);
+    blpm_startup_phase_end ("upower-devices");
 #ifdef ENABLE_POLKIT
     blpm_power_check_polkit_auth (power);
 #endif
@@ -1251,6 +1873,8 @@ out:
      * Emit org.freedesktop.PowerManagement session signals on startup
      */
     g_signal_emit (G_OBJECT (power), signals [ON_BATTERY_CHANGED], 0, power->priv->on_battery);
+
+    blpm_startup_phase_end ("power");
 }
 
 static void blpm_power_get_property (GObject *object,
@@ -1334,23 +1958,52 @@ blpm_power_finalize (GObject *object)
 
     g_free (power->priv->daemon_version);
 
+    if ( power->priv->sleep_request != NULL )
+    {
+	GError *error = NULL;
+
+	/* the sleep never happened, don't let the callers think it did */
+	g_set_error (&error, XFPM_ERROR, XFPM_ERROR_SLEEP_FAILED,
+		     _("The power manager exited before going to sleep"));
+	blpm_power_sleep_free (power->priv->sleep_request, error);
+	g_error_free (error);
+	power->priv->sleep_request = NULL;
+    }
+
     g_object_unref (power->priv->inhibit);
     g_object_unref (power->priv->notify);
     g_object_unref (power->priv->conf);
 
     if ( power->priv->systemd != NULL )
+    {
+        g_signal_handlers_disconnect_by_data (power->priv->systemd, power);
         g_object_unref (power->priv->systemd);
+    }
     if ( power->priv->console != NULL )
+    {
+        g_signal_handlers_disconnect_by_data (power->priv->console, power);
         g_object_unref (power->priv->console);
+    }
+
+    g_signal_handlers_disconnect_by_data (power->priv->network_manager, power);
+    g_object_unref (power->priv->network_manager);
+
+    g_signal_handlers_disconnect_by_data (power->priv->screen_locker, power);
+    g_object_unref (power->priv->screen_locker);
+
+    if ( power->priv->state_changed_id != 0 )
+	g_source_remove (power->priv->state_changed_id);
 
     dbus_g_connection_unref (power->priv->bus);
 
     g_hash_table_destroy (power->priv->hash);
 
 #ifdef ENABLE_POLKIT
+    g_signal_handlers_disconnect_by_data (power->priv->polkit, power);
     g_object_unref (power->priv->polkit);
 #endif
 
+    blpm_resume_state_free (power->priv->resume_state);
     g_object_unref(power->priv->dpms);
 
     G_OBJECT_CLASS (blpm_power_parent_class)->finalize (object);
@@ -1487,6 +2140,91 @@ blpm_power_is_in_presentation_mode (XfpmPower *power)
     return power->priv->presentation_mode;
 }
 
+struct XfpmResumeState *
+blpm_power_get_resume_state (XfpmPower *power)
+{
+    g_return_val_if_fail (XFPM_IS_POWER (power), NULL);
+
+    return power->priv->resume_state;
+}
+
+gdouble
+blpm_power_get_resume_latency (XfpmPower *power)
+{
+    g_return_val_if_fail (XFPM_IS_POWER (power), -1);
+
+    return power->priv->resume_latency;
+}
+
+/*
+ * All of the published state, for clients that just subscribed to
+ * state-changed. Free with g_hash_table_destroy.
+ */
+GHashTable *
+blpm_power_get_state (XfpmPower *power)
+{
+    gboolean state [XFPM_POWER_STATE_N];
+    GHashTable *hash;
+    gint i;
+
+    g_return_val_if_fail (XFPM_IS_POWER (power), NULL);
+
+    blpm_power_read_state (power, state);
+
+    hash = blpm_power_state_hash_new ();
+    for ( i = 0; i < XFPM_POWER_STATE_N; i++ )
+	blpm_power_state_insert (hash, i, state [i]);
+
+    return hash;
+}
+
+/*
+ * The last sleep cycles, oldest first, one tab separated line each.
+ * Marks are in ms since the sleeping signal, "-" when not reached, and
+ * a stage mark ends with "!" when the stage was cut by its deadline.
+ */
+gchar *
+blpm_power_sleep_timings_to_string (XfpmPower *power)
+{
+    GString *str;
+    guint i, j, index;
+
+    g_return_val_if_fail (XFPM_IS_POWER (power), NULL);
+
+    str = g_string_new ("# started\ttype");
+    for ( j = 0; j < XFPM_SLEEP_MARK_N; j++ )
+	g_string_append_printf (str, "\t%s", blpm_sleep_mark_names [j]);
+    g_string_append_c (str, '\n');
+
+    for ( i = 0; i < power->priv->sleep_timings_len; i++ )
+    {
+	const XfpmSleepTiming *timing;
+
+	index = (power->priv->sleep_timings_next + XFPM_SLEEP_TIMINGS - power->priv->sleep_timings_len + i) % XFPM_SLEEP_TIMINGS;
+	timing = &power->priv->sleep_timings [index];
+
+	g_string_append_printf (str, "%" G_GINT64_FORMAT ".%03d\t%s",
+				timing->started / G_USEC_PER_SEC,
+				(gint) ((timing->started % G_USEC_PER_SEC) / 1000),
+				timing->hibernate ? "hibernate" : "suspend");
+
+	for ( j = 0; j < XFPM_SLEEP_MARK_N; j++ )
+	{
+	    if ( timing->marks [j] == 0 )
+		g_string_append (str, "\t-");
+	    else
+		g_string_append_printf (str, "\t%.1f%s",
+					(timing->marks [j] - timing->marks [XFPM_SLEEP_MARK_SLEEPING]) / 1000.0,
+					j >= XFPM_SLEEP_MARK_SNAPSHOT &&
+					j < XFPM_SLEEP_MARK_SNAPSHOT + XFPM_SLEEP_STAGE_N &&
+					timing->timed_out [j - XFPM_SLEEP_MARK_SNAPSHOT] ? "!" : "");
+	}
+	g_string_append_c (str, '\n');
+    }
+
+    return g_string_free (str, FALSE);
+}
+
 
 /*
  *
@@ -1499,11 +2237,11 @@ static gboolean blpm_power_dbus_shutdown (XfpmPower *power,
 static gboolean blpm_power_dbus_reboot   (XfpmPower *power,
 					GError **error);
 
-static gboolean blpm_power_dbus_hibernate (XfpmPower * power,
-					 GError **error);
+static void blpm_power_dbus_hibernate (XfpmPower * power,
+				       DBusGMethodInvocation *context);
 
-static gboolean blpm_power_dbus_suspend (XfpmPower * power,
-				       GError ** error);
+static void blpm_power_dbus_suspend (XfpmPower * power,
+				     DBusGMethodInvocation *context);
 
 static gboolean blpm_power_dbus_can_reboot (XfpmPower * power,
 					  gboolean * OUT_can_reboot,
@@ -1617,50 +2355,58 @@ static gboolean blpm_power_dbus_reboot   (XfpmPower *power,
     return TRUE;
 }
 
-static gboolean blpm_power_dbus_hibernate (XfpmPower * power,
-					 GError **error)
+static void blpm_power_dbus_hibernate (XfpmPower * power,
+				       DBusGMethodInvocation *context)
 {
+    GError *error = NULL;
+
     if ( !power->priv->auth_hibernate )
     {
-	g_set_error (error, XFPM_ERROR, XFPM_ERROR_PERMISSION_DENIED,
+	g_set_error (&error, XFPM_ERROR, XFPM_ERROR_PERMISSION_DENIED,
                     _("Permission denied"));
-        return FALSE;
-
+	dbus_g_method_return_error (context, error);
+	g_error_free (error);
+        return;
     }
 
     if (!power->priv->can_hibernate )
     {
-	g_set_error (error, XFPM_ERROR, XFPM_ERROR_NO_HARDWARE_SUPPORT,
+	g_set_error (&error, XFPM_ERROR, XFPM_ERROR_NO_HARDWARE_SUPPORT,
                     _("Suspend not supported"));
-        return FALSE;
+	dbus_g_method_return_error (context, error);
+	g_error_free (error);
+        return;
     }
 
-    blpm_power_sleep (power, "Hibernate", FALSE);
-
-    return TRUE;
+    /* answered once the system is back */
+    blpm_power_sleep_async (power, "Hibernate", FALSE, context);
 }
 
-static gboolean blpm_power_dbus_suspend (XfpmPower * power,
-				       GError ** error)
+static void blpm_power_dbus_suspend (XfpmPower * power,
+				     DBusGMethodInvocation *context)
 {
+    GError *error = NULL;
+
     if ( !power->priv->auth_suspend )
     {
-	g_set_error (error, XFPM_ERROR, XFPM_ERROR_PERMISSION_DENIED,
+	g_set_error (&error, XFPM_ERROR, XFPM_ERROR_PERMISSION_DENIED,
                     _("Permission denied"));
-        return FALSE;
-
+	dbus_g_method_return_error (context, error);
+	g_error_free (error);
+        return;
     }
 
     if (!power->priv->can_suspend )
     {
-	g_set_error (error, XFPM_ERROR, XFPM_ERROR_NO_HARDWARE_SUPPORT,
+	g_set_error (&error, XFPM_ERROR, XFPM_ERROR_NO_HARDWARE_SUPPORT,
                     _("Suspend not supported"));
-        return FALSE;
+	dbus_g_method_return_error (context, error);
+	g_error_free (error);
+        return;
     }
 
-    blpm_power_sleep (power, "Suspend", FALSE);
-
-    return TRUE;
+    /* answered once the system is back */
+    blpm_power_sleep_async (power, "Suspend", FALSE, context);
 }
 
 static gboolean blpm_power_dbus_can_reboot (XfpmPower * power,
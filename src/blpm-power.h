@@ -60,6 +60,9 @@ typedef struct
     void		(*ask_shutdown)			(XfpmPower *power);
     
     void		(*shutdown)			(XfpmPower *power);
+
+    void		(*state_changed)		(XfpmPower *power,
+							 GHashTable *changed);
     
 } XfpmPowerClass;
 
@@ -77,6 +80,14 @@ gboolean		blpm_power_has_battery		(XfpmPower *power);
 
 gboolean        blpm_power_is_in_presentation_mode (XfpmPower *power);
 
+struct XfpmResumeState *blpm_power_get_resume_state	(XfpmPower *power);
+
+gdouble			blpm_power_get_resume_latency	(XfpmPower *power);
+
+gchar                  *blpm_power_sleep_timings_to_string (XfpmPower *power);
+
+GHashTable             *blpm_power_get_state		(XfpmPower *power);
+
 G_END_DECLS
 
 #endif /* __XFPM_POWER_H */
@@ -0,0 +1,142 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gdk/gdk.h>
+
+#include "blpm-resume-state.h"
+#include "blpm-debug.h"
+
+struct XfpmResumeState
+{
+    XfpmDpms         *dpms;
+    XfpmBacklight    *backlight;	/* weak */
+    XfpmKbdBacklight *kbd_backlight;	/* weak */
+
+    gboolean          captured;
+
+    gboolean          has_brightness;
+    gint32            brightness_level;
+
+    gboolean          has_kbd_brightness;
+    gint              kbd_brightness_level;
+};
+
+XfpmResumeState *
+blpm_resume_state_new (XfpmDpms *dpms)
+{
+    XfpmResumeState *state;
+
+    state = g_new0 (XfpmResumeState, 1);
+    state->dpms = g_object_ref (dpms);
+
+    return state;
+}
+
+void
+blpm_resume_state_free (XfpmResumeState *state)
+{
+    if ( state == NULL )
+	return;
+
+    blpm_resume_state_set_backlight (state, NULL);
+    blpm_resume_state_set_kbd_backlight (state, NULL);
+    g_object_unref (state->dpms);
+
+    g_free (state);
+}
+
+void
+blpm_resume_state_set_backlight (XfpmResumeState *state, XfpmBacklight *backlight)
+{
+    if ( state->backlight != NULL )
+	g_object_remove_weak_pointer (G_OBJECT (state->backlight), (gpointer *) &state->backlight);
+
+    state->backlight = backlight;
+
+    if ( state->backlight != NULL )
+	g_object_add_weak_pointer (G_OBJECT (state->backlight), (gpointer *) &state->backlight);
+}
+
+void
+blpm_resume_state_set_kbd_backlight (XfpmResumeState *state, XfpmKbdBacklight *kbd_backlight)
+{
+    if ( state->kbd_backlight != NULL )
+	g_object_remove_weak_pointer (G_OBJECT (state->kbd_backlight), (gpointer *) &state->kbd_backlight);
+
+    state->kbd_backlight = kbd_backlight;
+
+    if ( state->kbd_backlight != NULL )
+	g_object_add_weak_pointer (G_OBJECT (state->kbd_backlight), (gpointer *) &state->kbd_backlight);
+}
+
+void
+blpm_resume_state_capture (XfpmResumeState *state)
+{
+    state->has_brightness = state->backlight != NULL &&
+			    blpm_backlight_has_hw (state->backlight) &&
+			    blpm_backlight_get_level (state->backlight, &state->brightness_level);
+
+    state->has_kbd_brightness = FALSE;
+    if ( state->kbd_backlight != NULL && blpm_kbd_backlight_has_hw (state->kbd_backlight) )
+    {
+	state->kbd_brightness_level = blpm_kbd_backlight_get_brightness (state->kbd_backlight);
+	state->has_kbd_brightness = state->kbd_brightness_level >= 0;
+    }
+
+    state->captured = TRUE;
+
+    XFPM_DEBUG ("Captured brightness=%d kbd=%d",
+		state->has_brightness ? state->brightness_level : -1,
+		state->has_kbd_brightness ? state->kbd_brightness_level : -1);
+}
+
+/*
+ * Put everything back in one go, the X requests are only flushed once
+ * at the end.
+ */
+void
+blpm_resume_state_restore (XfpmResumeState *state)
+{
+    if ( !state->captured )
+	return;
+
+    /* The server may have dropped our timeouts while we were away. The
+     * DPMS inhibit is left as it is now, presentation mode or an
+     * inhibitor may have changed it while we slept. The monitor level
+     * is not put back, an idle or lid suspend usually starts with the
+     * panel already off and we must not wake up to a black screen */
+    blpm_dpms_refresh (state->dpms);
+
+    if ( state->has_brightness && state->backlight != NULL )
+	blpm_backlight_restore_level (state->backlight, state->brightness_level);
+
+    if ( state->has_kbd_brightness && state->kbd_backlight != NULL )
+	blpm_kbd_backlight_restore_brightness (state->kbd_backlight, state->kbd_brightness_level);
+
+    gdk_flush ();
+
+    state->captured = FALSE;
+
+    XFPM_DEBUG ("Resume state restored");
+}
@@ -0,0 +1,55 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __XFPM_RESUME_STATE_H
+#define __XFPM_RESUME_STATE_H
+
+#include <glib-object.h>
+
+#include "blpm-backlight.h"
+#include "blpm-kbd-backlight.h"
+#include "blpm-dpms.h"
+
+G_BEGIN_DECLS
+
+/*
+ * What the session looked like right before going to sleep, taken from
+ * the objects that are already running so nothing has to be probed
+ * again around a suspend.
+ */
+typedef struct XfpmResumeState XfpmResumeState;
+
+XfpmResumeState	*blpm_resume_state_new			(XfpmDpms *dpms);
+
+void		 blpm_resume_state_free			(XfpmResumeState *state);
+
+void		 blpm_resume_state_set_backlight	(XfpmResumeState *state,
+							 XfpmBacklight *backlight);
+
+void		 blpm_resume_state_set_kbd_backlight	(XfpmResumeState *state,
+							 XfpmKbdBacklight *kbd_backlight);
+
+void		 blpm_resume_state_capture		(XfpmResumeState *state);
+
+void		 blpm_resume_state_restore		(XfpmResumeState *state);
+
+G_END_DECLS
+
+#endif /* __XFPM_RESUME_STATE_H */
@@ -0,0 +1,474 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+#include "blpm-screen-locker.h"
+#include "blpm-dbus-monitor.h"
+#include "blpm-debug.h"
+#include "blpm-marshal.h"
+
+static void blpm_screen_locker_finalize   (GObject *object);
+
+#define XFPM_SCREEN_LOCKER_GET_PRIVATE(o) \
+(G_TYPE_INSTANCE_GET_PRIVATE ((o), XFPM_TYPE_SCREEN_LOCKER, XfpmScreenLockerPrivate))
+
+#define SCREENSAVER_SERVICE	"org.freedesktop.ScreenSaver"
+#define SCREENSAVER_PATH	"/org/freedesktop/ScreenSaver"
+#define SCREENSAVER_INTERFACE	"org.freedesktop.ScreenSaver"
+
+/*
+ * Fallbacks when nobody owns org.freedesktop.ScreenSaver, in order of
+ * preference. Only the ones found in $PATH are tried.
+ */
+static const gchar *blpm_screen_locker_commands [] =
+{
+    "xflock4",
+    "gnome-screensaver-command -l",
+    "xdg-screensaver lock",
+    "xscreensaver-command -lock"
+};
+
+#define XFPM_SCREEN_LOCKER_N_COMMANDS G_N_ELEMENTS (blpm_screen_locker_commands)
+
+/* give up on a locker that never reports the screen as locked */
+#define XFPM_SCREEN_LOCKER_TIMEOUT	10
+
+struct XfpmScreenLockerPrivate
+{
+    DBusGConnection *bus;
+    DBusGProxy      *proxy;
+    DBusGProxy      *bus_proxy;
+    
+    XfpmDBusMonitor *monitor;
+    
+    /* org.freedesktop.ScreenSaver has an owner that didn't fail us */
+    gboolean         dbus_locker;
+    DBusGProxyCall  *owner_call;
+    DBusGProxyCall  *call;
+    
+    /* Commands found in $PATH, probed on the first lock */
+    gboolean         probed;
+    gboolean         available [XFPM_SCREEN_LOCKER_N_COMMANDS];
+    guint            command;	/* the cached winner */
+    
+    GPid             pid;
+    guint            child_watch_id;
+    
+    gboolean         lock_pending;
+    guint            timeout_id;
+};
+
+enum
+{
+    LOCK_FINISHED,
+    LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+G_DEFINE_TYPE (XfpmScreenLocker, blpm_screen_locker, G_TYPE_OBJECT)
+
+static void blpm_screen_locker_try_command (XfpmScreenLocker *locker);
+
+static void
+blpm_screen_locker_reap_cb (GPid pid, gint status, gpointer data)
+{
+    g_spawn_close_pid (pid);
+}
+
+static void
+blpm_screen_locker_finished (XfpmScreenLocker *locker, gboolean locked, gboolean timed_out)
+{
+    if ( !locker->priv->lock_pending )
+	return;
+	
+    XFPM_DEBUG ("Screen lock %s", locked ? "done" : timed_out ? "timed out" : "failed");
+    
+    if ( locker->priv->timeout_id != 0 )
+    {
+	g_source_remove (locker->priv->timeout_id);
+	locker->priv->timeout_id = 0;
+    }
+    
+    /* a GetActive nobody waits for anymore */
+    if ( locker->priv->call )
+    {
+	dbus_g_proxy_cancel_call (locker->priv->proxy, locker->priv->call);
+	locker->priv->call = NULL;
+    }
+    
+    /* A command that is still running only needs to be reaped now */
+    if ( locker->priv->child_watch_id != 0 )
+    {
+	g_source_remove (locker->priv->child_watch_id);
+	locker->priv->child_watch_id = 0;
+	g_child_watch_add (locker->priv->pid, blpm_screen_locker_reap_cb, NULL);
+    }
+    
+    locker->priv->lock_pending = FALSE;
+    g_signal_emit (G_OBJECT (locker), signals [LOCK_FINISHED], 0, locked, timed_out);
+}
+
+static gboolean
+blpm_screen_locker_timeout_cb (gpointer data)
+{
+    XfpmScreenLocker *locker = data;
+    
+    XFPM_WARNING ("Screen locker didn't answer within %d seconds", XFPM_SCREEN_LOCKER_TIMEOUT);
+    
+    locker->priv->timeout_id = 0;
+    blpm_screen_locker_finished (locker, FALSE, TRUE);
+    
+    return FALSE;
+}
+
+static void
+blpm_screen_locker_probe (XfpmScreenLocker *locker)
+{
+    gchar **argv;
+    gchar *path;
+    guint i;
+    
+    for ( i = 0; i < XFPM_SCREEN_LOCKER_N_COMMANDS; i++ )
+    {
+	argv = g_strsplit (blpm_screen_locker_commands [i], " ", 2);
+	path = g_find_program_in_path (argv [0]);
+	
+	locker->priv->available [i] = path != NULL;
+	XFPM_DEBUG ("Screen locker %s: %s", argv [0], path != NULL ? path : "not found");
+	
+	g_free (path);
+	g_strfreev (argv);
+    }
+    
+    locker->priv->probed = TRUE;
+    locker->priv->command = 0;
+}
+
+static void
+blpm_screen_locker_child_watch_cb (GPid pid, gint status, gpointer data)
+{
+    XfpmScreenLocker *locker = data;
+    
+    g_spawn_close_pid (pid);
+    locker->priv->child_watch_id = 0;
+    
+    if ( WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS )
+    {
+	blpm_screen_locker_finished (locker, TRUE, FALSE);
+	return;
+    }
+    
+    /* Present but not working, the next one becomes the winner */
+    XFPM_DEBUG ("'%s' failed, trying the next locker",
+		blpm_screen_locker_commands [locker->priv->command]);
+    locker->priv->command++;
+    blpm_screen_locker_try_command (locker);
+}
+
+static void
+blpm_screen_locker_try_command (XfpmScreenLocker *locker)
+{
+    GError *error = NULL;
+    gchar **argv = NULL;
+    guint i;
+    
+    if ( !locker->priv->probed )
+	blpm_screen_locker_probe (locker);
+    
+    for ( i = locker->priv->command; i < XFPM_SCREEN_LOCKER_N_COMMANDS; i++ )
+    {
+	if ( !locker->priv->available [i] )
+	    continue;
+	    
+	if ( g_shell_parse_argv (blpm_screen_locker_commands [i], NULL, &argv, NULL) &&
+	     g_spawn_async (NULL, argv, NULL,
+			    G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+			    NULL, NULL, &locker->priv->pid, &error) )
+	{
+	    g_strfreev (argv);
+	    locker->priv->command = i;
+	    locker->priv->child_watch_id = g_child_watch_add (locker->priv->pid,
+							      blpm_screen_locker_child_watch_cb,
+							      locker);
+	    return;
+	}
+	
+	if ( error )
+	{
+	    XFPM_DEBUG ("Unable to run '%s': %s", blpm_screen_locker_commands [i], error->message);
+	    g_clear_error (&error);
+	}
+	g_strfreev (argv);
+	argv = NULL;
+	locker->priv->available [i] = FALSE;
+    }
+    
+    /* Nothing left, look again next time */
+    g_warning ("Cannot lock screen");
+    locker->priv->probed = FALSE;
+    blpm_screen_locker_finished (locker, FALSE, FALSE);
+}
+
+static void
+blpm_screen_locker_active_changed_cb (DBusGProxy *proxy, gboolean active, XfpmScreenLocker *locker)
+{
+    if ( active )
+	blpm_screen_locker_finished (locker, TRUE, FALSE);
+}
+
+static void
+blpm_screen_locker_get_active_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmScreenLocker *locker = data;
+    gboolean active = FALSE;
+    
+    locker->priv->call = NULL;
+    
+    /* Otherwise wait for ActiveChanged */
+    if ( dbus_g_proxy_end_call (proxy, call, NULL,
+				G_TYPE_BOOLEAN, &active,
+				G_TYPE_INVALID) && active )
+	blpm_screen_locker_finished (locker, TRUE, FALSE);
+}
+
+static void
+blpm_screen_locker_lock_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmScreenLocker *locker = data;
+    GError *error = NULL;
+    
+    locker->priv->call = NULL;
+    
+    if ( !dbus_g_proxy_end_call (proxy, call, &error, G_TYPE_INVALID) )
+    {
+	XFPM_DEBUG ("%s Lock failed: %s", SCREENSAVER_SERVICE, error->message);
+	g_error_free (error);
+	
+	/* Don't ask it again until it is replaced */
+	locker->priv->dbus_locker = FALSE;
+	blpm_screen_locker_try_command (locker);
+	return;
+    }
+    
+    /* Lock returns as soon as it is requested, the locker may not be up yet */
+    locker->priv->call = dbus_g_proxy_begin_call (locker->priv->proxy, "GetActive",
+						  blpm_screen_locker_get_active_reply,
+						  locker, NULL,
+						  G_TYPE_INVALID);
+}
+
+static void
+blpm_screen_locker_has_owner_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer data)
+{
+    XfpmScreenLocker *locker = data;
+    gboolean has_owner = FALSE;
+    
+    locker->priv->owner_call = NULL;
+    
+    if ( dbus_g_proxy_end_call (proxy, call, NULL,
+				G_TYPE_BOOLEAN, &has_owner,
+				G_TYPE_INVALID) )
+    {
+	XFPM_DEBUG ("%s %s", SCREENSAVER_SERVICE, has_owner ? "is running" : "is not running");
+	locker->priv->dbus_locker = has_owner;
+    }
+}
+
+static void
+blpm_screen_locker_service_connection_changed_cb (XfpmDBusMonitor *monitor,
+						  gchar *service_name,
+						  gboolean connected,
+						  gboolean on_session,
+						  XfpmScreenLocker *locker)
+{
+    if ( !on_session || g_strcmp0 (service_name, SCREENSAVER_SERVICE) != 0 )
+	return;
+	
+    XFPM_DEBUG ("%s %s", SCREENSAVER_SERVICE, connected ? "appeared" : "went away");
+    
+    locker->priv->dbus_locker = connected;
+}
+
+static void
+blpm_screen_locker_class_init (XfpmScreenLockerClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+    signals [LOCK_FINISHED] =
+    	g_signal_new ("lock-finished",
+		      XFPM_TYPE_SCREEN_LOCKER,
+		      G_SIGNAL_RUN_LAST,
+		      G_STRUCT_OFFSET (XfpmScreenLockerClass, lock_finished),
+		      NULL, NULL,
+		      _blpm_marshal_VOID__BOOLEAN_BOOLEAN,
+		      G_TYPE_NONE, 2, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN);
+
+    object_class->finalize = blpm_screen_locker_finalize;
+
+    g_type_class_add_private (klass, sizeof (XfpmScreenLockerPrivate));
+}
+
+static void
+blpm_screen_locker_init (XfpmScreenLocker *locker)
+{
+    GError *error = NULL;
+
+    locker->priv = XFPM_SCREEN_LOCKER_GET_PRIVATE (locker);
+    
+    locker->priv->bus = dbus_g_bus_get (DBUS_BUS_SESSION, &error);
+    
+    if ( error )
+    {
+	/* Still usable through the commands */
+	g_warning ("%s", error->message);
+	g_error_free (error);
+	return;
+    }
+    
+    locker->priv->proxy = dbus_g_proxy_new_for_name (locker->priv->bus,
+						     SCREENSAVER_SERVICE,
+						     SCREENSAVER_PATH,
+						     SCREENSAVER_INTERFACE);
+    
+    dbus_g_proxy_add_signal (locker->priv->proxy, "ActiveChanged", G_TYPE_BOOLEAN, G_TYPE_INVALID);
+    dbus_g_proxy_connect_signal (locker->priv->proxy, "ActiveChanged",
+				 G_CALLBACK (blpm_screen_locker_active_changed_cb), locker, NULL);
+    
+    locker->priv->monitor = blpm_dbus_monitor_new ();
+    blpm_dbus_monitor_add_service (locker->priv->monitor, DBUS_BUS_SESSION, SCREENSAVER_SERVICE);
+    g_signal_connect (locker->priv->monitor, "service-connection-changed",
+		      G_CALLBACK (blpm_screen_locker_service_connection_changed_cb), locker);
+    
+    locker->priv->bus_proxy = dbus_g_proxy_new_for_name (locker->priv->bus,
+							 DBUS_SERVICE_DBUS,
+							 DBUS_PATH_DBUS,
+							 DBUS_INTERFACE_DBUS);
+    
+    locker->priv->owner_call = dbus_g_proxy_begin_call (locker->priv->bus_proxy, "NameHasOwner",
+							blpm_screen_locker_has_owner_reply,
+							locker, NULL,
+							G_TYPE_STRING, SCREENSAVER_SERVICE,
+							G_TYPE_INVALID);
+}
+
+static void
+blpm_screen_locker_finalize (GObject *object)
+{
+    XfpmScreenLocker *locker;
+
+    locker = XFPM_SCREEN_LOCKER (object);
+    
+    if ( locker->priv->timeout_id != 0 )
+	g_source_remove (locker->priv->timeout_id);
+    
+    if ( locker->priv->child_watch_id != 0 )
+	g_source_remove (locker->priv->child_watch_id);
+    
+    if ( locker->priv->monitor )
+    {
+	g_signal_handlers_disconnect_by_data (locker->priv->monitor, locker);
+	blpm_dbus_monitor_remove_service (locker->priv->monitor, DBUS_BUS_SESSION, SCREENSAVER_SERVICE);
+	g_object_unref (locker->priv->monitor);
+    }
+    
+    if ( locker->priv->bus_proxy )
+    {
+	if ( locker->priv->owner_call )
+	    dbus_g_proxy_cancel_call (locker->priv->bus_proxy, locker->priv->owner_call);
+	g_object_unref (locker->priv->bus_proxy);
+    }
+    
+    if ( locker->priv->proxy )
+    {
+	if ( locker->priv->call )
+	    dbus_g_proxy_cancel_call (locker->priv->proxy, locker->priv->call);
+	dbus_g_proxy_disconnect_signal (locker->priv->proxy, "ActiveChanged",
+					G_CALLBACK (blpm_screen_locker_active_changed_cb), locker);
+	g_object_unref (locker->priv->proxy);
+    }
+    
+    if ( locker->priv->bus )
+	dbus_g_connection_unref (locker->priv->bus);
+
+    G_OBJECT_CLASS (blpm_screen_locker_parent_class)->finalize (object);
+}
+
+XfpmScreenLocker *
+blpm_screen_locker_new (void)
+{
+    static gpointer locker_obj = NULL;
+    
+    if ( G_LIKELY (locker_obj != NULL ) )
+    {
+	g_object_ref (locker_obj);
+    }
+    else
+    {
+	locker_obj = g_object_new (XFPM_TYPE_SCREEN_LOCKER, NULL);
+	g_object_add_weak_pointer (locker_obj, &locker_obj);
+    }
+    
+    return XFPM_SCREEN_LOCKER (locker_obj);
+}
+
+/*
+ * Locks the screen with the cached locker, "lock-finished" tells
+ * whether it worked once the locker is up, every candidate failed or
+ * none answered within XFPM_SCREEN_LOCKER_TIMEOUT seconds.
+ */
+void
+blpm_screen_locker_lock (XfpmScreenLocker *locker)
+{
+    g_return_if_fail (XFPM_IS_SCREEN_LOCKER (locker));
+    
+    /* The running attempt will answer for this one too */
+    if ( locker->priv->lock_pending )
+	return;
+	
+    locker->priv->lock_pending = TRUE;
+    locker->priv->timeout_id = g_timeout_add_seconds (XFPM_SCREEN_LOCKER_TIMEOUT,
+						      blpm_screen_locker_timeout_cb, locker);
+    
+    if ( locker->priv->dbus_locker )
+    {
+	locker->priv->call = dbus_g_proxy_begin_call (locker->priv->proxy, "Lock",
+						      blpm_screen_locker_lock_reply,
+						      locker, NULL,
+						      G_TYPE_INVALID);
+	return;
+    }
+    
+    blpm_screen_locker_try_command (locker);
+}
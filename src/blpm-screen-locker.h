@@ -0,0 +1,59 @@
+/*
+ * * Copyright (C) 2026 The blade-pm developers
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __XFPM_SCREEN_LOCKER_H
+#define __XFPM_SCREEN_LOCKER_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define XFPM_TYPE_SCREEN_LOCKER        (blpm_screen_locker_get_type () )
+#define XFPM_SCREEN_LOCKER(o)          (G_TYPE_CHECK_INSTANCE_CAST ((o), XFPM_TYPE_SCREEN_LOCKER, XfpmScreenLocker))
+#define XFPM_IS_SCREEN_LOCKER(o)       (G_TYPE_CHECK_INSTANCE_TYPE ((o), XFPM_TYPE_SCREEN_LOCKER))
+
+typedef struct XfpmScreenLockerPrivate XfpmScreenLockerPrivate;
+
+typedef struct
+{
+    GObject         		parent;
+    XfpmScreenLockerPrivate    *priv;
+    
+} XfpmScreenLocker;
+
+typedef struct
+{
+    GObjectClass 		parent_class;
+    
+    void                        (*lock_finished)	(XfpmScreenLocker *locker,
+							 gboolean locked,
+							 gboolean timed_out);
+    
+} XfpmScreenLockerClass;
+
+GType        			blpm_screen_locker_get_type      (void) G_GNUC_CONST;
+
+XfpmScreenLocker	       *blpm_screen_locker_new           (void);
+
+void				blpm_screen_locker_lock		 (XfpmScreenLocker *locker);
+
+G_END_DECLS
+
+#endif /* __XFPM_SCREEN_LOCKER_H */
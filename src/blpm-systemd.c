@@ -35,6 +35,7 @@
 
 #include "blpm-systemd.h"
 #include "blpm-polkit.h"
+#include "blpm-debug.h"
 
 static void blpm_systemd_finalize   (GObject *object);
 
@@ -118,44 +119,82 @@ blpm_systemd_class_init (XfpmSystemdClass *klass)
     g_type_class_add_private (klass, sizeof (XfpmSystemdPrivate));
 }
 
-static gboolean
-blpm_systemd_can_method (XfpmSystemd  *systemd,
-                         gboolean     *can_method,
-                         const gchar  *method)
+#ifdef ENABLE_POLKIT
+static void
+blpm_systemd_auth_result_cb (XfpmPolkit   *polkit,
+                             const gchar  *action_id,
+                             gboolean      is_authorized,
+                             XfpmSystemd  *systemd)
 {
-    *can_method = FALSE;
+    gboolean    *can_method;
+    const gchar *property;
 
-#ifdef ENABLE_POLKIT
-    *can_method = blpm_polkit_check_auth(systemd->priv->polkit, method);
+    if ( g_strcmp0 (action_id, SYSTEMD_POWEROFF_TEST) == 0 )
+    {
+        can_method = &systemd->priv->can_shutdown;
+        property = "can-shutdown";
+    }
+    else if ( g_strcmp0 (action_id, SYSTEMD_REBOOT_TEST) == 0 )
+    {
+        can_method = &systemd->priv->can_restart;
+        property = "can-restart";
+    }
+    else if ( g_strcmp0 (action_id, SYSTEMD_SUSPEND_TEST) == 0 )
+    {
+        can_method = &systemd->priv->can_suspend;
+        property = "can-suspend";
+    }
+    else if ( g_strcmp0 (action_id, SYSTEMD_HIBERNATE_TEST) == 0 )
+    {
+        can_method = &systemd->priv->can_hibernate;
+        property = "can-hibernate";
+    }
+    else
+    {
+        return;
+    }
 
-    return TRUE;
-#endif
+    if ( *can_method != is_authorized )
+    {
+        *can_method = is_authorized;
+        g_object_notify (G_OBJECT (systemd), property);
+    }
+}
 
-    return FALSE;
+static void
+blpm_systemd_check_auth (XfpmSystemd *systemd)
+{
+    /* all four go out at once, results arrive through auth-result */
+    blpm_polkit_check_auth_async (systemd->priv->polkit, SYSTEMD_POWEROFF_TEST);
+    blpm_polkit_check_auth_async (systemd->priv->polkit, SYSTEMD_REBOOT_TEST);
+    blpm_polkit_check_auth_async (systemd->priv->polkit, SYSTEMD_SUSPEND_TEST);
+    blpm_polkit_check_auth_async (systemd->priv->polkit, SYSTEMD_HIBERNATE_TEST);
 }
+#endif
 
 static void
 blpm_systemd_init (XfpmSystemd *systemd)
 {
     systemd->priv = XFPM_SYSTEMD_GET_PRIVATE (systemd);
-    systemd->priv->can_shutdown = FALSE;
-    systemd->priv->can_restart  = FALSE;
+
+    blpm_startup_phase_begin ("systemd");
+
+    systemd->priv->can_shutdown  = FALSE;
+    systemd->priv->can_restart   = FALSE;
+    systemd->priv->can_suspend   = FALSE;
+    systemd->priv->can_hibernate = FALSE;
 #ifdef ENABLE_POLKIT
     systemd->priv->polkit = blpm_polkit_get();
+
+    g_signal_connect (systemd->priv->polkit, "auth-result",
+                      G_CALLBACK (blpm_systemd_auth_result_cb), systemd);
+    g_signal_connect_swapped (systemd->priv->polkit, "auth-changed",
+                              G_CALLBACK (blpm_systemd_check_auth), systemd);
+
+    blpm_systemd_check_auth (systemd);
 #endif
 
-    blpm_systemd_can_method (systemd,
-                             &systemd->priv->can_shutdown,
-                             SYSTEMD_POWEROFF_TEST);
-    blpm_systemd_can_method (systemd,
-                             &systemd->priv->can_restart,
-                             SYSTEMD_REBOOT_TEST);
-    blpm_systemd_can_method (systemd,
-                             &systemd->priv->can_suspend,
-                             SYSTEMD_SUSPEND_TEST);
-    blpm_systemd_can_method (systemd,
-                             &systemd->priv->can_hibernate,
-                             SYSTEMD_HIBERNATE_TEST);
+    blpm_startup_phase_end ("systemd");
 }
 
 static void blpm_systemd_get_property (GObject *object,
@@ -196,6 +235,7 @@ blpm_systemd_finalize (GObject *object)
 
     if(systemd->priv->polkit)
     {
+        g_signal_handlers_disconnect_by_data (systemd->priv->polkit, systemd);
         g_object_unref (G_OBJECT (systemd->priv->polkit));
         systemd->priv->polkit = NULL;
     }
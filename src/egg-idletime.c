@@ -41,6 +41,9 @@
 
 static void     egg_idletime_finalize   (GObject       *object);
 
+/* flush the histogram to disk at most this often, in seconds */
+#define EGG_IDLETIME_HISTOGRAM_SAVE_DELAY	60
+
 #define EGG_IDLETIME_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), EGG_IDLETIME_TYPE, EggIdletimePrivate))
 
 /*
@@ -58,6 +61,11 @@ struct EggIdletimePrivate
 	XSyncCounter		 idle_counter;
 	GPtrArray		*array;
 	Display			*dpy;
+	gboolean		 on_battery;
+	gint64			 idle_value;
+	gint64			 idle_mark;
+	guint			 histogram [EGG_IDLETIME_HISTOGRAM_LAST][EGG_IDLETIME_HISTOGRAM_BUCKETS];
+	guint			 histogram_save_id;
 };
 
 typedef struct
@@ -105,6 +113,158 @@ egg_idletime_get_time (EggIdletime *idletime)
 	return egg_idletime_xsyncvalue_to_int64 (value);
 }
 
+/**
+ * egg_idletime_histogram_get_filename:
+ */
+static gchar *
+egg_idletime_histogram_get_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "blade-pm", "idle-histogram", NULL);
+}
+
+/**
+ * egg_idletime_histogram_load:
+ */
+static void
+egg_idletime_histogram_load (EggIdletime *idletime)
+{
+	GKeyFile *keyfile;
+	gchar *filename;
+	gint *values;
+	gsize length;
+	guint i, j;
+	const gchar *keys [] = { "on-ac", "on-battery" };
+
+	filename = egg_idletime_histogram_get_filename ();
+	keyfile = g_key_file_new ();
+	if (!g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL))
+		goto out;
+
+	for (i=0; i<EGG_IDLETIME_HISTOGRAM_LAST; i++) {
+		values = g_key_file_get_integer_list (keyfile, "Histogram", keys[i], &length, NULL);
+		if (values == NULL)
+			continue;
+		for (j=0; j<length && j<EGG_IDLETIME_HISTOGRAM_BUCKETS; j++)
+			idletime->priv->histogram[i][j] = MAX (values[j], 0);
+		g_free (values);
+	}
+out:
+	g_key_file_free (keyfile);
+	g_free (filename);
+}
+
+/**
+ * egg_idletime_histogram_save:
+ */
+static void
+egg_idletime_histogram_save (EggIdletime *idletime)
+{
+	GKeyFile *keyfile;
+	GError *error = NULL;
+	gchar *filename;
+	gchar *dirname;
+	gchar *data;
+	gsize length;
+	gint values [EGG_IDLETIME_HISTOGRAM_BUCKETS];
+	guint i, j;
+	const gchar *keys [] = { "on-ac", "on-battery" };
+
+	keyfile = g_key_file_new ();
+	for (i=0; i<EGG_IDLETIME_HISTOGRAM_LAST; i++) {
+		for (j=0; j<EGG_IDLETIME_HISTOGRAM_BUCKETS; j++)
+			values[j] = (gint) MIN (idletime->priv->histogram[i][j], (guint) G_MAXINT);
+		g_key_file_set_integer_list (keyfile, "Histogram", keys[i], values, EGG_IDLETIME_HISTOGRAM_BUCKETS);
+	}
+	data = g_key_file_to_data (keyfile, &length, NULL);
+
+	filename = egg_idletime_histogram_get_filename ();
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+	if (!g_file_set_contents (filename, data, length, &error)) {
+		g_warning ("failed to save idle histogram: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_free (data);
+	g_key_file_free (keyfile);
+}
+
+/**
+ * egg_idletime_histogram_save_cb:
+ */
+static gboolean
+egg_idletime_histogram_save_cb (EggIdletime *idletime)
+{
+	idletime->priv->histogram_save_id = 0;
+	egg_idletime_histogram_save (idletime);
+	return FALSE;
+}
+
+/**
+ * egg_idletime_histogram_add:
+ *
+ * Records the idle period that just ended. Only periods long enough to
+ * trip at least one alarm are seen, which are the only ones the dim,
+ * blank and sleep timeouts care about anyway.
+ */
+static void
+egg_idletime_histogram_add (EggIdletime *idletime)
+{
+	gint64 elapsed;
+	guint64 secs;
+	guint bucket;
+
+	/* the reset alarm was never armed for this period */
+	if (idletime->priv->idle_mark == 0)
+		return;
+
+	/* counter value when the first alarm fired, plus however long
+	 * we stayed idle after that */
+	elapsed = (g_get_monotonic_time () - idletime->priv->idle_mark) / 1000;
+	secs = (idletime->priv->idle_value + elapsed) / 1000;
+
+	/* bucket n holds [2^n, 2^(n+1)) seconds, the first also holds < 1s */
+	bucket = secs < 2 ? 0 : g_bit_storage (secs) - 1;
+	bucket = MIN (bucket, EGG_IDLETIME_HISTOGRAM_BUCKETS - 1);
+
+	idletime->priv->histogram[idletime->priv->on_battery ?
+				  EGG_IDLETIME_HISTOGRAM_ON_BATTERY :
+				  EGG_IDLETIME_HISTOGRAM_ON_AC][bucket]++;
+
+	if (idletime->priv->histogram_save_id == 0)
+		idletime->priv->histogram_save_id =
+			g_timeout_add_seconds (EGG_IDLETIME_HISTOGRAM_SAVE_DELAY,
+					       (GSourceFunc) egg_idletime_histogram_save_cb, idletime);
+}
+
+/**
+ * egg_idletime_get_histogram:
+ *
+ * Return value: %EGG_IDLETIME_HISTOGRAM_BUCKETS counts of completed idle
+ * periods, owned by @idletime. Bucket n counts periods of 2^n to 2^(n+1)
+ * seconds, the last bucket counts everything longer.
+ */
+const guint *
+egg_idletime_get_histogram (EggIdletime *idletime, EggIdletimeHistogram histogram)
+{
+	g_return_val_if_fail (EGG_IS_IDLETIME (idletime), NULL);
+	g_return_val_if_fail (histogram < EGG_IDLETIME_HISTOGRAM_LAST, NULL);
+
+	return idletime->priv->histogram[histogram];
+}
+
+/**
+ * egg_idletime_set_on_battery:
+ */
+void
+egg_idletime_set_on_battery (EggIdletime *idletime, gboolean on_battery)
+{
+	g_return_if_fail (EGG_IS_IDLETIME (idletime));
+	idletime->priv->on_battery = on_battery;
+}
+
 /**
  * egg_idletime_xsync_alarm_set:
  */
@@ -173,6 +333,7 @@ egg_idletime_alarm_reset_all (EggIdletime *idletime)
 
 	/* we need to be reset again on the next event */
 	idletime->priv->reset_set = FALSE;
+	idletime->priv->idle_mark = 0;
 }
 
 /**
@@ -215,6 +376,10 @@ egg_idletime_set_reset_alarm (EggIdletime *idletime, XSyncAlarmNotifyEvent *alar
 
 		/* don't try to set this again if multiple timers are going off in sequence */
 		idletime->priv->reset_set = TRUE;
+
+		/* remember where this idle period stood for the histogram */
+		idletime->priv->idle_value = egg_idletime_xsyncvalue_to_int64 (alarm_event->counter_value);
+		idletime->priv->idle_mark = g_get_monotonic_time ();
 	}
 }
 
@@ -258,6 +423,7 @@ egg_idletime_event_filter_cb (GdkXEvent *gdkxevent, GdkEvent *event, gpointer da
 
 	/* are we the reset alarm? */
 	if (eggalarm->id == 0) {
+		egg_idletime_histogram_add (idletime);
 		egg_idletime_alarm_reset_all (idletime);
 		goto out;
 	}
@@ -401,6 +567,11 @@ egg_idletime_init (EggIdletime *idletime)
 	idletime->priv->idle_counter = None;
 	idletime->priv->sync_event = 0;
 	idletime->priv->dpy = gdk_x11_get_default_xdisplay ();
+	idletime->priv->on_battery = FALSE;
+	idletime->priv->idle_mark = 0;
+	idletime->priv->histogram_save_id = 0;
+
+	egg_idletime_histogram_load (idletime);
 
 	/* get the sync event */
 	if (!XSyncQueryExtension (idletime->priv->dpy, &idletime->priv->sync_event, &sync_error)) {
@@ -453,6 +624,12 @@ egg_idletime_finalize (GObject *object)
 	}
 	g_ptr_array_free (idletime->priv->array, TRUE);
 
+	/* flush anything recorded since the last save */
+	if (idletime->priv->histogram_save_id != 0) {
+		g_source_remove (idletime->priv->histogram_save_id);
+		egg_idletime_histogram_save (idletime);
+	}
+
 	G_OBJECT_CLASS (egg_idletime_parent_class)->finalize (object);
 }
 
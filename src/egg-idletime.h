@@ -42,6 +42,15 @@ enum
     TIMEOUT_INACTIVITY_ON_BATTERY
 };
 
+#define EGG_IDLETIME_HISTOGRAM_BUCKETS	16
+
+typedef enum
+{
+	EGG_IDLETIME_HISTOGRAM_ON_AC,
+	EGG_IDLETIME_HISTOGRAM_ON_BATTERY,
+	EGG_IDLETIME_HISTOGRAM_LAST
+} EggIdletimeHistogram;
+
 typedef struct EggIdletimePrivate EggIdletimePrivate;
 
 typedef struct
@@ -68,6 +77,10 @@ gboolean	 egg_idletime_alarm_set			(EggIdletime	*idletime,
 gboolean	 egg_idletime_alarm_remove		(EggIdletime	*idletime,
 							 guint		 alarm_id);
 gint64		 egg_idletime_get_time			(EggIdletime	*idletime);
+void		 egg_idletime_set_on_battery		(EggIdletime	*idletime,
+							 gboolean	 on_battery);
+const guint	*egg_idletime_get_histogram		(EggIdletime	*idletime,
+							 EggIdletimeHistogram histogram);
 #ifdef EGG_TEST
 void		 egg_idletime_test			(gpointer	 data);
 #endif